@@ -0,0 +1,389 @@
+// host_freertos.c
+// FreeRTOS tasks, notifications, queues, mutexes and byte ring buffers on top of pthreads for the host build.
+// Priorities are ignored; pinned tasks get a CPU affinity so the two render
+// tasks really run on two cores of the host.
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include "host_idf.h"
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *param;
+    char name[16];
+    int core_id;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify_value;
+};
+
+struct host_mutex {
+    pthread_mutex_t lock;
+};
+
+// Byte buffer only: one item out at a time, returned before the next
+struct host_ringbuf {
+    pthread_mutex_t lock;
+    size_t size;
+    size_t head;
+    size_t count;
+    size_t lent;        // bytes handed out by xRingbufferReceiveUpTo and not yet returned
+    uint8_t *data;
+};
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t *items;
+};
+
+static __thread struct host_task *current_task = NULL;
+static struct timespec boot_time;
+static pthread_once_t boot_once = PTHREAD_ONCE_INIT;
+
+static void host_boot_init(void) {
+    clock_gettime(CLOCK_MONOTONIC, &boot_time);
+}
+
+int64_t esp_timer_get_time(void) {
+    pthread_once(&boot_once, host_boot_init);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)(now.tv_sec - boot_time.tv_sec) * 1000000LL + (now.tv_nsec - boot_time.tv_nsec) / 1000;
+}
+
+// Absolute deadline on the given clock for the pthread timed waits, ticks are ms
+static void host_deadline(struct timespec *ts, TickType_t ticks, clockid_t clock) {
+    clock_gettime(clock, ts);
+    ts->tv_sec += ticks / 1000;
+    ts->tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void host_cond_init(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void *host_task_trampoline(void *arg) {
+    struct host_task *t = (struct host_task *)arg;
+    current_task = t;
+    if (t->core_id != tskNO_AFFINITY) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        if (ncpu > 1) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(t->core_id % ncpu, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+    }
+    t->fn(t->param);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core_id) {
+    struct host_task *t = calloc(1, sizeof(struct host_task));
+    if (t == NULL) return pdFAIL;
+    t->fn = fn;
+    t->param = param;
+    t->core_id = core_id;
+    strncpy(t->name, name, sizeof(t->name) - 1);
+    pthread_mutex_init(&t->lock, NULL);
+    host_cond_init(&t->cond);
+    // The handle has to be visible before the task runs, tasks notify each other straight away
+    if (handle) *handle = t;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, stack_depth < 65536 ? 65536 : stack_depth);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&t->thread, &attr, host_task_trampoline, t);
+    pthread_attr_destroy(&attr);
+    if (err) {
+        if (handle) *handle = NULL;
+        free(t);
+        return pdFAIL;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *param,
+                       UBaseType_t priority, TaskHandle_t *handle) {
+    return xTaskCreatePinnedToCore(fn, name, stack_depth, param, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t handle) {
+    if (handle == NULL || handle == current_task) {
+        pthread_exit(NULL);
+    }
+    pthread_cancel(handle->thread);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    usleep((useconds_t)ticks * portTICK_PERIOD_MS * 1000);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / (1000 * portTICK_PERIOD_MS));
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle) {
+    pthread_mutex_lock(&handle->lock);
+    handle->notify_value++;
+    pthread_cond_signal(&handle->cond);
+    pthread_mutex_unlock(&handle->lock);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t handle, BaseType_t *higher_priority_task_woken) {
+    xTaskNotifyGive(handle);
+    if (higher_priority_task_woken) *higher_priority_task_woken = pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+    struct host_task *t = current_task;
+    struct timespec deadline;
+    if (ticks_to_wait != portMAX_DELAY) host_deadline(&deadline, ticks_to_wait, CLOCK_MONOTONIC);
+    pthread_mutex_lock(&t->lock);
+    while (t->notify_value == 0) {
+        if (ticks_to_wait == portMAX_DELAY) {
+            pthread_cond_wait(&t->cond, &t->lock);
+        } else if (ticks_to_wait == 0 || pthread_cond_timedwait(&t->cond, &t->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    uint32_t value = t->notify_value;
+    if (value) {
+        t->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return value;
+}
+
+void vPortEnterCritical(portMUX_TYPE *mux) {
+    while (__atomic_exchange_n(&mux->locked, 1, __ATOMIC_ACQUIRE)) sched_yield();
+}
+
+void vPortExitCritical(portMUX_TYPE *mux) {
+    __atomic_store_n(&mux->locked, 0, __ATOMIC_RELEASE);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    struct host_mutex *m = calloc(1, sizeof(struct host_mutex));
+    if (m) pthread_mutex_init(&m->lock, NULL);
+    return m;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks_to_wait) {
+    if (ticks_to_wait == portMAX_DELAY) {
+        return pthread_mutex_lock(&sem->lock) == 0 ? pdTRUE : pdFALSE;
+    }
+    // pthread_mutex_timedlock always measures against CLOCK_REALTIME
+    struct timespec deadline;
+    host_deadline(&deadline, ticks_to_wait, CLOCK_REALTIME);
+    return pthread_mutex_timedlock(&sem->lock, &deadline) == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    return pthread_mutex_unlock(&sem->lock) == 0 ? pdTRUE : pdFALSE;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    struct host_queue *q = calloc(1, sizeof(struct host_queue));
+    if (q == NULL) return NULL;
+    q->items = calloc(length, item_size);
+    if (q->items == NULL) {
+        free(q);
+        return NULL;
+    }
+    q->length = length;
+    q->item_size = item_size;
+    pthread_mutex_init(&q->lock, NULL);
+    host_cond_init(&q->changed);
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    free(queue->items);
+    free(queue);
+}
+
+// Wait on the queue's condition until ready() holds, lock held, returns 0 on timeout
+static int host_queue_wait(struct host_queue *q, int (*ready)(struct host_queue *), TickType_t ticks_to_wait) {
+    struct timespec deadline;
+    if (ticks_to_wait != portMAX_DELAY) host_deadline(&deadline, ticks_to_wait, CLOCK_MONOTONIC);
+    while (!ready(q)) {
+        if (ticks_to_wait == portMAX_DELAY) {
+            pthread_cond_wait(&q->changed, &q->lock);
+        } else if (ticks_to_wait == 0 || pthread_cond_timedwait(&q->changed, &q->lock, &deadline) == ETIMEDOUT) {
+            return ready(q);
+        }
+    }
+    return 1;
+}
+
+static int host_queue_has_space(struct host_queue *q) {
+    return q->count < q->length;
+}
+
+static int host_queue_has_items(struct host_queue *q) {
+    return q->count > 0;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait) {
+    pthread_mutex_lock(&queue->lock);
+    if (!host_queue_wait(queue, host_queue_has_space, ticks_to_wait)) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+    queue->count++;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait) {
+    pthread_mutex_lock(&queue->lock);
+    if (!host_queue_wait(queue, host_queue_has_items, ticks_to_wait)) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+    memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+// For a queue of one: replaces what's there
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item) {
+    pthread_mutex_lock(&queue->lock);
+    memcpy(queue->items + queue->head * queue->item_size, item, queue->item_size);
+    queue->count = 1;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->head = 0;
+    queue->count = 0;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t spaces = queue->length - queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return spaces;
+}
+
+// There are no interrupts on the host, "ISRs" are just other threads
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_task_woken) {
+    if (higher_priority_task_woken) *higher_priority_task_woken = pdFALSE;
+    return xQueueSend(queue, item, 0);
+}
+
+UBaseType_t uxQueueMessagesWaitingFromISR(QueueHandle_t queue) {
+    return uxQueueMessagesWaiting(queue);
+}
+
+BaseType_t xQueueIsQueueFullFromISR(QueueHandle_t queue) {
+    return uxQueueSpacesAvailable(queue) == 0;
+}
+
+RingbufHandle_t xRingbufferCreate(size_t size, RingbufferType_t type) {
+    if (type != RINGBUF_TYPE_BYTEBUF) return NULL;
+    struct host_ringbuf *r = calloc(1, sizeof(struct host_ringbuf));
+    if (r == NULL) return NULL;
+    r->data = malloc(size);
+    if (r->data == NULL) {
+        free(r);
+        return NULL;
+    }
+    r->size = size;
+    pthread_mutex_init(&r->lock, NULL);
+    return r;
+}
+
+void vRingbufferDelete(RingbufHandle_t ring) {
+    free(ring->data);
+    free(ring);
+}
+
+// All or nothing, like the IDF's byte buffer
+BaseType_t xRingbufferSendFromISR(RingbufHandle_t ring, const void *data, size_t size, BaseType_t *higher_priority_task_woken) {
+    if (higher_priority_task_woken) *higher_priority_task_woken = pdFALSE;
+    pthread_mutex_lock(&ring->lock);
+    if (ring->count + size > ring->size) {
+        pthread_mutex_unlock(&ring->lock);
+        return pdFALSE;
+    }
+    for (size_t i = 0; i < size; i++) {
+        ring->data[(ring->head + ring->count + i) % ring->size] = ((const uint8_t *)data)[i];
+    }
+    ring->count += size;
+    pthread_mutex_unlock(&ring->lock);
+    return pdTRUE;
+}
+
+// Doesn't wait: the slave only asks for what it was told is there
+void *xRingbufferReceiveUpTo(RingbufHandle_t ring, size_t *item_size, TickType_t ticks_to_wait, size_t max_size) {
+    pthread_mutex_lock(&ring->lock);
+    size_t len = ring->count;
+    if (len > ring->size - ring->head) len = ring->size - ring->head;
+    if (len > max_size) len = max_size;
+    ring->lent = len;
+    void *item = len ? ring->data + ring->head : NULL;
+    pthread_mutex_unlock(&ring->lock);
+    *item_size = len;
+    return item;
+}
+
+void vRingbufferReturnItem(RingbufHandle_t ring, void *item) {
+    pthread_mutex_lock(&ring->lock);
+    ring->head = (ring->head + ring->lent) % ring->size;
+    ring->count -= ring->lent;
+    ring->lent = 0;
+    pthread_mutex_unlock(&ring->lock);
+}
+
+void vRingbufferGetInfo(RingbufHandle_t ring, UBaseType_t *free, UBaseType_t *read, UBaseType_t *write,
+                        UBaseType_t *acquire, UBaseType_t *items_waiting) {
+    pthread_mutex_lock(&ring->lock);
+    if (free) *free = ring->size - ring->count;
+    if (read) *read = ring->head;
+    if (write) *write = (ring->head + ring->count) % ring->size;
+    if (acquire) *acquire = (ring->head + ring->count) % ring->size;
+    if (items_waiting) *items_waiting = ring->count;
+    pthread_mutex_unlock(&ring->lock);
+}
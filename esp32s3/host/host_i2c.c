@@ -0,0 +1,267 @@
+// host_i2c.c
+// I2C stand-ins for the host build.
+//  - The master bus logs every transmit (decoded as WM8960 register writes)
+//    and takes as long as the transfer would on the wire.
+//  - The slave replaces esp32-hal-i2c-slave.c: a task reads the messages file
+//    or pipe and hands each line to the receive callback as one I2C write.
+//    A line "@<ms>" waits until that many ms after the slave started,
+//    lines starting with '#' are comments. A line "!<hex bytes>" is sent as
+//    those raw bytes, for the chip's binary commands. A line "?<n> <hex bytes>"
+//    is a read: it writes the bytes (if any), then reads n and prints them.
+
+#include <string.h>
+#include <unistd.h>
+#include "host_idf.h"
+#include "esp32-hal-i2c-slave.h"
+
+static const char *TAG = "host_i2c";
+
+struct host_i2c_bus {
+    int port;
+    FILE *log;
+};
+
+struct host_i2c_dev {
+    struct host_i2c_bus *bus;
+    uint16_t address;
+    uint32_t scl_speed_hz;
+};
+
+static struct host_i2c_bus host_master_bus;
+static uint32_t master_transactions = 0;
+static uint32_t master_devices_added = 0;
+static int64_t master_wire_us = 0;
+
+// START + address + data, 9 clocks a byte, STOP
+static int64_t host_i2c_wire_us(size_t bytes, uint32_t scl_speed_hz) {
+    return (int64_t)(bytes + 1) * 9 * 1000000LL / scl_speed_hz + 1000000LL / scl_speed_hz;
+}
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *bus_config, i2c_master_bus_handle_t *ret_bus_handle) {
+    host_master_bus.port = bus_config->i2c_port;
+    if (host_config.codec_log_path && host_master_bus.log == NULL) {
+        host_master_bus.log = fopen(host_config.codec_log_path, "w");
+    }
+    *ret_bus_handle = &host_master_bus;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t *dev_config, i2c_master_dev_handle_t *ret_handle) {
+    struct host_i2c_dev *dev = calloc(1, sizeof(struct host_i2c_dev));
+    if (dev == NULL) return ESP_ERR_NO_MEM;
+    dev->bus = bus_handle;
+    dev->address = dev_config->device_address;
+    dev->scl_speed_hz = dev_config->scl_speed_hz ? dev_config->scl_speed_hz : 100000;
+    master_devices_added++;
+    *ret_handle = dev;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_rm_device(i2c_master_dev_handle_t handle) {
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer, size_t write_size, int xfer_timeout_ms) {
+    int64_t wire_us = host_i2c_wire_us(write_size, i2c_dev->scl_speed_hz);
+    usleep((useconds_t)wire_us);
+    master_wire_us += wire_us;
+    master_transactions++;
+    FILE *log = i2c_dev->bus->log;
+    if (log) {
+        if (i2c_dev->address == 0x1A && write_size == 2) {
+            // WM8960: 7 bit register address, 9 bit value
+            fprintf(log, "R%u=0x%03x\n", write_buffer[0] >> 1, ((write_buffer[0] & 1) << 8) | write_buffer[1]);
+        } else {
+            fprintf(log, "0x%02x:", i2c_dev->address);
+            for (size_t i = 0; i < write_size; i++) fprintf(log, " %02x", write_buffer[i]);
+            fprintf(log, "\n");
+        }
+        fflush(log);
+    }
+    return ESP_OK;
+}
+
+// ---- slave ----
+
+static i2c_slave_request_cb_t slave_request_cb = NULL;
+static i2c_slave_receive_cb_t slave_receive_cb = NULL;
+static void *slave_cb_arg = NULL;
+static uint8_t slave_num = 0;
+static uint32_t slave_frequency = 100000;
+static TaskHandle_t slave_task_handle = NULL;
+static uint32_t slave_messages = 0;
+static uint32_t slave_bytes = 0;
+static uint32_t slave_tx_bytes = 0;
+static uint32_t slave_reads = 0;
+
+// What the request callback queued for the master, like the driver's tx ring
+static uint8_t slave_tx_buf[4096];
+static size_t slave_tx_len = 0;
+
+// Like the driver's, one whole transaction
+static uint8_t *data_rx_buf = NULL;
+static size_t data_rx_len = 0;
+
+// "80 01" or "8001" -> { 0x80, 0x01 }
+size_t host_parse_hex(const char *hex, uint8_t *out, size_t max) {
+    size_t n = 0;
+    while (*hex && n < max) {
+        if (*hex == ' ') { hex++; continue; }
+        unsigned int byte;
+        if (sscanf(hex, "%2x", &byte) != 1) break;
+        out[n++] = (uint8_t)byte;
+        hex += (hex[1] && hex[1] != ' ') ? 2 : 1;
+    }
+    return n;
+}
+
+// A write of len bytes (maybe none) from data_rx_buf, repeated START and a
+// read of n bytes into slave_tx_buf, short of n if the slave ran dry
+static size_t host_i2c_slave_transfer(size_t len, size_t n) {
+    if (n > sizeof(slave_tx_buf)) n = sizeof(slave_tx_buf);
+    usleep((useconds_t)host_i2c_wire_us(len + n, slave_frequency));
+    slave_reads++;
+    slave_tx_len = 0;
+    if (slave_request_cb) {
+        slave_request_cb(slave_num, data_rx_buf, len > 255 ? 255 : len, slave_cb_arg);
+        while (slave_tx_len < n) {
+            size_t had = slave_tx_len;
+            slave_request_cb(slave_num, NULL, 0, slave_cb_arg);
+            if (slave_tx_len == had) break;
+        }
+    }
+    return slave_tx_len < n ? slave_tx_len : n;
+}
+
+static void host_i2c_slave_read(size_t len, size_t n) {
+    if (n > sizeof(slave_tx_buf)) n = sizeof(slave_tx_buf);
+    host_i2c_slave_transfer(len, n);
+    printf("i2c read");
+    for (size_t i = 0; i < len; i++) printf(" %02x", data_rx_buf[i]);
+    printf(" ->");
+    for (size_t i = 0; i < n; i++) printf(" %02x", i < slave_tx_len ? slave_tx_buf[i] : 0xff);
+    printf("\n");
+}
+
+static int64_t slave_receive_us = 0;
+
+int64_t host_i2c_receive_us(void) {
+    return slave_receive_us;
+}
+
+void host_i2c_master_write(const uint8_t *data, size_t len) {
+    if (data != data_rx_buf) {
+        if (len > data_rx_len) len = data_rx_len;
+        memcpy(data_rx_buf, data, len);
+    }
+    // The master clocks the bytes in before the STOP reaches us
+    usleep((useconds_t)host_i2c_wire_us(len, slave_frequency));
+    slave_messages++;
+    slave_bytes += len;
+    int64_t start = esp_timer_get_time();
+    if (slave_receive_cb) {
+        slave_receive_cb(slave_num, data_rx_buf, len, true, slave_cb_arg);
+    }
+    slave_receive_us += esp_timer_get_time() - start;
+}
+
+size_t host_i2c_master_read(const uint8_t *data, size_t len, uint8_t *out, size_t n) {
+    if (len > data_rx_len) len = data_rx_len;
+    memcpy(data_rx_buf, data, len);
+    n = host_i2c_slave_transfer(len, n);
+    memcpy(out, slave_tx_buf, n);
+    return n;
+}
+
+static void host_i2c_slave_task(void *pv_args) {
+    FILE *in = strcmp(host_config.messages_path, "-") ? fopen(host_config.messages_path, "r") : stdin;
+    if (in == NULL) {
+        ESP_LOGE(TAG, "can't open %s", host_config.messages_path);
+        vTaskDelete(NULL);
+    }
+    int64_t start_us = esp_timer_get_time();
+    // room for a full transaction written out as hex
+    static char line[8192];
+    while (fgets(line, sizeof(line), in)) {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = 0;
+        if (len == 0 || line[0] == '#') continue;
+        if (line[0] == '@') {
+            int64_t due_us = start_us + atoll(line + 1) * 1000LL;
+            int64_t now = esp_timer_get_time();
+            if (due_us > now) usleep((useconds_t)(due_us - now));
+            continue;
+        }
+        if (line[0] == '?') {
+            char *hex;
+            size_t n = strtoul(line + 1, &hex, 10);
+            host_i2c_slave_read(host_parse_hex(hex, data_rx_buf, data_rx_len), n);
+            continue;
+        }
+        if (line[0] == '!') {
+            len = host_parse_hex(line + 1, data_rx_buf, data_rx_len);
+        } else {
+            if (len > data_rx_len) len = data_rx_len;
+            memcpy(data_rx_buf, line, len);
+        }
+        host_i2c_master_write(data_rx_buf, len);
+    }
+    if (in != stdin) fclose(in);
+    slave_task_handle = NULL;
+    vTaskDelete(NULL);
+}
+
+esp_err_t i2cSlaveAttachCallbacks(uint8_t num, i2c_slave_request_cb_t request_callback, i2c_slave_receive_cb_t receive_callback, void * arg) {
+    slave_request_cb = request_callback;
+    slave_receive_cb = receive_callback;
+    slave_cb_arg = arg;
+    return ESP_OK;
+}
+
+esp_err_t i2cSlaveInit(uint8_t num, int sda, int scl, uint16_t slaveID, uint32_t frequency, size_t rx_len, size_t tx_len) {
+    ESP_LOGI(TAG, "Initialising I2C Slave: addr=0x%x, messages from %s", slaveID,
+             host_config.messages_path ? host_config.messages_path : "(none)");
+    slave_num = num;
+    slave_frequency = frequency ? frequency : 100000;
+    if (data_rx_buf == NULL) {
+        data_rx_buf = malloc(rx_len + 1);
+        if (data_rx_buf == NULL) return ESP_ERR_NO_MEM;
+        data_rx_len = rx_len;
+    }
+    if (host_config.messages_path && slave_task_handle == NULL) {
+        if (xTaskCreate(host_i2c_slave_task, "i2c_slave_task", 8192, NULL, 20, &slave_task_handle) != pdPASS) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2cSlaveDeinit(uint8_t num) {
+    if (slave_task_handle) {
+        vTaskDelete(slave_task_handle);
+        slave_task_handle = NULL;
+    }
+    return ESP_OK;
+}
+
+// The host build's slave never holds SCL and has no ring to overflow
+esp_err_t i2cSlaveGetRxStats(uint8_t num, i2c_slave_rx_stats_t *stats) {
+    memset(stats, 0, sizeof(i2c_slave_rx_stats_t));
+    return ESP_OK;
+}
+
+size_t i2cSlaveWrite(uint8_t num, const uint8_t *buf, uint32_t len, uint32_t timeout_ms) {
+    if (len > sizeof(slave_tx_buf) - slave_tx_len) len = sizeof(slave_tx_buf) - slave_tx_len;
+    memcpy(slave_tx_buf + slave_tx_len, buf, len);
+    slave_tx_len += len;
+    slave_tx_bytes += len;
+    return len;
+}
+
+void host_i2c_report(FILE *f) {
+    fprintf(f, "i2c master: %u transactions, %u device adds, %lld us on the wire\n",
+            master_transactions, master_devices_added, (long long)master_wire_us);
+    fprintf(f, "i2c slave: %u messages, %u bytes received, %u reads, %u bytes sent\n",
+            slave_messages, slave_bytes, slave_reads, slave_tx_bytes);
+}
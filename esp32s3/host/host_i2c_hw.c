@@ -0,0 +1,288 @@
+// host_i2c_hw.c
+// The simulated ESP32-S3 I2C slave peripheral and the master that drives it,
+// see host_i2c_hw.h. Bytes go out at the bus rate, 9 clocks each; a hold
+// stops the clock until the slave lets SCL go.
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include "host_i2c_hw.h"
+
+// i2c_stretch_cause_t in the HAL
+enum { STRETCH_MASTER_READ, STRETCH_TX_FIFO_EMPTY, STRETCH_RX_FIFO_FULL };
+
+typedef struct {
+    pthread_mutex_t lock;   // the FIFOs: the master, the handler and the slave task all use them
+    uint8_t rx[SOC_I2C_FIFO_LEN];
+    uint32_t rx_head;
+    uint32_t rx_count;
+    uint8_t tx[SOC_I2C_FIFO_LEN];
+    uint32_t tx_head;
+    uint32_t tx_count;
+    intr_handler_t handler;
+    void *arg;
+    uint32_t hz;
+    uint32_t timeout_us;
+    int64_t clock_ns;       // when the bus has clocked out what's been sent, 0 = idle
+    host_i2c_hw_stats_t stats;
+} host_i2c_sim_t;
+
+struct host_intr {
+    host_i2c_sim_t *sim;
+};
+
+i2c_dev_t I2C0;
+i2c_dev_t I2C1;
+static host_i2c_sim_t sims[SOC_I2C_NUM] = {
+    [0 ... SOC_I2C_NUM - 1] = { .lock = PTHREAD_MUTEX_INITIALIZER, .hz = 400000, .timeout_us = 1000000 }
+};
+
+static host_i2c_sim_t *sim_of(i2c_dev_t *hw) {
+    return hw == &I2C1 ? &sims[1] : &sims[0];
+}
+
+static int64_t sim_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// ---- the FIFOs ----
+
+void i2c_ll_get_rxfifo_cnt(i2c_dev_t *hw, uint32_t *length) {
+    host_i2c_sim_t *s = sim_of(hw);
+    pthread_mutex_lock(&s->lock);
+    *length = s->rx_count;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void i2c_ll_get_txfifo_len(i2c_dev_t *hw, uint32_t *length) {
+    host_i2c_sim_t *s = sim_of(hw);
+    pthread_mutex_lock(&s->lock);
+    *length = SOC_I2C_FIFO_LEN - s->tx_count;
+    pthread_mutex_unlock(&s->lock);
+}
+
+// Like the chip, reading an empty FIFO or writing a full one just goes wrong
+void i2c_ll_read_rxfifo(i2c_dev_t *hw, uint8_t *ptr, uint8_t len) {
+    host_i2c_sim_t *s = sim_of(hw);
+    pthread_mutex_lock(&s->lock);
+    for (uint8_t i = 0; i < len; i++) {
+        ptr[i] = s->rx[s->rx_head];
+        if (s->rx_count) {
+            s->rx_head = (s->rx_head + 1) % SOC_I2C_FIFO_LEN;
+            s->rx_count--;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+void i2c_ll_write_txfifo(i2c_dev_t *hw, const uint8_t *ptr, uint8_t len) {
+    host_i2c_sim_t *s = sim_of(hw);
+    pthread_mutex_lock(&s->lock);
+    for (uint8_t i = 0; i < len && s->tx_count < SOC_I2C_FIFO_LEN; i++) {
+        s->tx[(s->tx_head + s->tx_count++) % SOC_I2C_FIFO_LEN] = ptr[i];
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+void i2c_ll_rxfifo_rst(i2c_dev_t *hw) {
+    host_i2c_sim_t *s = sim_of(hw);
+    pthread_mutex_lock(&s->lock);
+    s->rx_head = s->rx_count = 0;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void i2c_ll_txfifo_rst(i2c_dev_t *hw) {
+    host_i2c_sim_t *s = sim_of(hw);
+    pthread_mutex_lock(&s->lock);
+    s->tx_head = s->tx_count = 0;
+    pthread_mutex_unlock(&s->lock);
+}
+
+// ---- interrupts and pins ----
+
+esp_err_t esp_intr_alloc(int source, int flags, intr_handler_t handler, void *arg, intr_handle_t *ret_handle) {
+    if (source != ETS_I2C_EXT0_INTR_SOURCE && source != ETS_I2C_EXT1_INTR_SOURCE) return ESP_ERR_NOT_FOUND;
+    struct host_intr *intr = malloc(sizeof(struct host_intr));
+    if (intr == NULL) return ESP_ERR_NO_MEM;
+    intr->sim = &sims[source == ETS_I2C_EXT1_INTR_SOURCE];
+    intr->sim->arg = arg;
+    __atomic_store_n(&intr->sim->handler, handler, __ATOMIC_RELEASE);
+    *ret_handle = intr;
+    return ESP_OK;
+}
+
+esp_err_t esp_intr_free(intr_handle_t handle) {
+    __atomic_store_n(&handle->sim->handler, NULL, __ATOMIC_RELEASE);
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t gpio_config(const gpio_config_t *config) { return ESP_OK; }
+esp_err_t gpio_set_level(int gpio_num, uint32_t level) { return ESP_OK; }
+int gpio_get_level(int gpio_num) { return 1; }
+void gpio_matrix_out(uint32_t gpio, uint32_t signal_idx, bool out_inv, bool oen_inv) { }
+void gpio_matrix_in(uint32_t gpio, uint32_t signal_idx, bool inv) { }
+
+// Run the handler while an enabled interrupt is raised, as the CPU would. The
+// slave task can enable one at any time, so the master looks again while it waits.
+static void sim_interrupt(i2c_dev_t *hw, host_i2c_sim_t *s) {
+    intr_handler_t handler;
+    while ((handler = __atomic_load_n(&s->handler, __ATOMIC_ACQUIRE)) != NULL &&
+           (__atomic_load_n(&hw->int_raw.val, __ATOMIC_ACQUIRE) & hw->int_ena.val)) {
+        int64_t start = sim_now_ns();
+        handler(s->arg);
+        s->stats.interrupt_ns += sim_now_ns() - start;
+        s->stats.interrupts++;
+    }
+}
+
+static void sim_raise(i2c_dev_t *hw, host_i2c_sim_t *s, uint32_t bits) {
+    __atomic_fetch_or(&hw->int_raw.val, bits, __ATOMIC_ACQ_REL);
+    sim_interrupt(hw, s);
+}
+
+// ---- the master ----
+
+// Wait for the bus to clock out `clocks` more SCL periods
+static void sim_clock(host_i2c_sim_t *s, uint32_t clocks) {
+    int64_t now = sim_now_ns();
+    if (s->clock_ns < now) s->clock_ns = now;
+    s->clock_ns += (int64_t)clocks * 1000000000LL / s->hz;
+    struct timespec until = { s->clock_ns / 1000000000LL, s->clock_ns % 1000000000LL };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) != 0) { }
+}
+
+// Hold SCL until the slave writes slave_scl_stretch_clr; false if it never does
+static bool sim_stretch(i2c_dev_t *hw, host_i2c_sim_t *s, uint32_t cause) {
+    if (!hw->scl_stretch_conf.slave_scl_stretch_en) return true;
+    hw->scl_stretch_conf.slave_scl_stretch_clr = 0;
+    hw->sr.stretch_cause = cause;
+    s->stats.stretches[cause]++;
+    int64_t start = esp_timer_get_time();
+    sim_raise(hw, s, I2C_SLAVE_STRETCH_INT_ENA);
+    while (!hw->scl_stretch_conf.slave_scl_stretch_clr) {
+        if (esp_timer_get_time() - start > s->timeout_us) {
+            s->stats.timeouts++;
+            return false;
+        }
+        usleep(2);
+        sim_interrupt(hw, s);
+    }
+    uint32_t held = (uint32_t)(esp_timer_get_time() - start);
+    if (held > s->stats.stretch_us_max) s->stats.stretch_us_max = held;
+    return true;
+}
+
+static void sim_start(i2c_dev_t *hw, host_i2c_sim_t *s, bool read) {
+    hw->sr.slave_rw = read;
+    hw->sr.slave_addressed = 1;
+    sim_clock(s, 10);   // START, address and R/W, ACK
+}
+
+static bool sim_send(i2c_dev_t *hw, host_i2c_sim_t *s, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        sim_clock(s, 9);
+        for (;;) {
+            pthread_mutex_lock(&s->lock);
+            bool full = s->rx_count == SOC_I2C_FIFO_LEN;
+            pthread_mutex_unlock(&s->lock);
+            if (!full) break;
+            if (!sim_stretch(hw, s, STRETCH_RX_FIFO_FULL)) return false;
+            // held for nothing, the chip would stretch again
+        }
+        pthread_mutex_lock(&s->lock);
+        bool wm = false;
+        if (s->rx_count < SOC_I2C_FIFO_LEN) {
+            s->rx[(s->rx_head + s->rx_count++) % SOC_I2C_FIFO_LEN] = data[i];
+            wm = s->rx_count >= hw->rxfifo_wm_thrhd;
+        } else {
+            s->stats.overflows++;
+        }
+        pthread_mutex_unlock(&s->lock);
+        if (wm) sim_raise(hw, s, I2C_RXFIFO_WM_INT_ENA);
+    }
+    return true;
+}
+
+static bool sim_receive(i2c_dev_t *hw, host_i2c_sim_t *s, uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        sim_clock(s, 9);
+        pthread_mutex_lock(&s->lock);
+        bool empty = s->tx_count == 0;
+        pthread_mutex_unlock(&s->lock);
+        if (empty && !sim_stretch(hw, s, STRETCH_TX_FIFO_EMPTY)) return false;
+        pthread_mutex_lock(&s->lock);
+        bool wm = false;
+        if (s->tx_count) {
+            data[i] = s->tx[s->tx_head];
+            s->tx_head = (s->tx_head + 1) % SOC_I2C_FIFO_LEN;
+            s->tx_count--;
+            wm = s->tx_count < hw->txfifo_wm_thrhd;
+        } else {
+            // still nothing after the hold, SDA floats high
+            data[i] = 0xff;
+            s->stats.underflows++;
+        }
+        pthread_mutex_unlock(&s->lock);
+        if (wm) sim_raise(hw, s, I2C_TXFIFO_WM_INT_ENA);
+    }
+    return true;
+}
+
+static int64_t sim_stop(i2c_dev_t *hw, host_i2c_sim_t *s) {
+    sim_clock(s, 1);
+    int64_t stop_us = esp_timer_get_time();
+    sim_raise(hw, s, I2C_TRANS_COMPLETE_INT_ENA);
+    hw->sr.slave_addressed = 0;
+    hw->sr.slave_rw = 0;
+    return stop_us;
+}
+
+// The default 50 us timer slack would swamp a byte time
+static void sim_thread_init(void) {
+    static __thread bool done = false;
+    if (!done) {
+        prctl(PR_SET_TIMERSLACK, 1UL);
+        done = true;
+    }
+}
+
+void host_i2c_hw_set_hz(i2c_dev_t *hw, uint32_t hz) {
+    sim_of(hw)->hz = hz;
+}
+
+void host_i2c_hw_set_timeout_us(i2c_dev_t *hw, uint32_t us) {
+    sim_of(hw)->timeout_us = us;
+}
+
+int64_t host_i2c_hw_write(i2c_dev_t *hw, const uint8_t *data, size_t len) {
+    host_i2c_sim_t *s = sim_of(hw);
+    sim_thread_init();
+    sim_start(hw, s, false);
+    bool ok = sim_send(hw, s, data, len);
+    int64_t stop_us = sim_stop(hw, s);
+    return ok ? stop_us : -1;
+}
+
+int64_t host_i2c_hw_write_read(i2c_dev_t *hw, const uint8_t *cmd, size_t cmd_len, uint8_t *data, size_t len) {
+    host_i2c_sim_t *s = sim_of(hw);
+    sim_thread_init();
+    sim_start(hw, s, false);
+    bool ok = sim_send(hw, s, cmd, cmd_len);
+    if (ok) {
+        // repeated START: SCL is held until the slave has an answer
+        sim_start(hw, s, true);
+        ok = sim_stretch(hw, s, STRETCH_MASTER_READ) && sim_receive(hw, s, data, len);
+    }
+    int64_t stop_us = sim_stop(hw, s);
+    return ok ? stop_us : -1;
+}
+
+void host_i2c_hw_get_stats(i2c_dev_t *hw, host_i2c_hw_stats_t *stats) {
+    *stats = sim_of(hw)->stats;
+}
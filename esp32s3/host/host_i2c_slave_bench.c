@@ -0,0 +1,257 @@
+// host_i2c_slave_bench.c
+// Runs the real I2C slave driver, ../main/esp32-hal-i2c-slave.c, against the
+// simulated peripheral in host_i2c_hw.c. The Makefile builds it twice:
+// i2c-slave-bench with the ISR filling message slots (I2C_SLAVE_FAST_RX=1) and
+// i2c-slave-bench-ring with the ring buffer and event queue (=0), so the two
+// receive paths can be compared on the same writes.
+//
+//   latency       spaced short writes, a quick callback: STOP to dispatch
+//   backpressure  long writes back to back into a slow callback: SCL is held
+//                 for want of room, and nothing may be lost or reordered
+//   reads         write-then-reads behind a queue of long writes: the read is
+//                 answered in order, after the writes, once there's room
+//
+// Every write carries a sequence number; each test checks that the callbacks
+// saw every one, in order, intact. Exits 1 if any check fails.
+
+#include <getopt.h>
+#include <string.h>
+#include <unistd.h>
+#include "host_idf.h"
+#include "host_i2c_hw.h"
+#include "esp32-hal-i2c-slave.h"
+
+#ifndef I2C_SLAVE_FAST_RX
+#define I2C_SLAVE_FAST_RX 1
+#endif
+
+#define BENCH_PORT 0
+#define BENCH_ADDR 0x58       // ESP_SLAVE_ADDR
+#define BENCH_RX_LEN 2048     // I2C_SLAVE_MAX_WRITE
+#define BENCH_TX_LEN 256
+#define BENCH_WRITE 0x01
+#define BENCH_READ 0xa5
+#define BENCH_HEADER 5        // type, then the sequence number
+#define BENCH_REPLY 8
+
+typedef struct {
+    volatile uint32_t next;   // sequence number the callbacks expect
+    uint32_t errors;
+    uint32_t slow_us;         // callback time, to make the task the bottleneck
+    uint32_t *dispatch_us;    // per write, from i2cSlaveGetRxStats
+    uint32_t samples;
+    uint32_t max_samples;
+} bench_state_t;
+
+static bench_state_t bench;
+
+static size_t bench_len(uint32_t seq, size_t min, size_t max) {
+    return min == max ? min : min + (seq * 131) % (max - min + 1);
+}
+
+static void bench_fill(uint8_t *buf, uint8_t type, uint32_t seq, size_t len) {
+    buf[0] = type;
+    memcpy(buf + 1, &seq, 4);
+    for (size_t i = BENCH_HEADER; i < len; i++) buf[i] = (uint8_t)(seq + i);
+}
+
+static void bench_error(const char *what, uint32_t seq, size_t len) {
+    if (bench.errors++ == 0) {
+        fprintf(stderr, "  %s: expected #%u, got #%u (%u bytes)\n", what, bench.next, seq, (unsigned)len);
+    }
+}
+
+// Checks the header and payload, returns the sequence number
+static uint32_t bench_check(const uint8_t *data, size_t len, uint8_t type) {
+    uint32_t seq = UINT32_MAX;
+    if (len >= BENCH_HEADER && data[0] == type) memcpy(&seq, data + 1, 4);
+    if (seq != bench.next) {
+        bench_error(type == BENCH_WRITE ? "write out of order or lost" : "read out of order or lost", seq, len);
+        return seq;
+    }
+    for (size_t i = BENCH_HEADER; i < len; i++) {
+        if (data[i] != (uint8_t)(seq + i)) {
+            bench_error("write corrupted", seq, len);
+            break;
+        }
+    }
+    return seq;
+}
+
+static void bench_receive(uint8_t num, uint8_t *data, size_t len, bool stop, void *arg) {
+    bench_check(data, len, BENCH_WRITE);
+    if (bench.samples < bench.max_samples) {
+        i2c_slave_rx_stats_t stats;
+        i2cSlaveGetRxStats(num, &stats);
+        bench.dispatch_us[bench.samples++] = stats.dispatch_us_last;
+    }
+    if (bench.slow_us) usleep(bench.slow_us);
+    bench.next++;
+}
+
+// cmd is NULL when the ISR finds the TX FIFO empty mid-read
+static void bench_request(uint8_t num, uint8_t *cmd, uint8_t cmd_len, void *arg) {
+    if (cmd == NULL) return;
+    uint32_t seq = bench_check(cmd, cmd_len, BENCH_READ);
+    uint8_t reply[BENCH_REPLY];
+    for (int i = 0; i < BENCH_REPLY; i++) reply[i] = (uint8_t)(seq * 7 + i);
+    i2cSlaveWrite(num, reply, sizeof(reply), 0);
+    bench.next++;
+}
+
+static void bench_reset(uint32_t slow_us) {
+    bench.next = 0;
+    bench.errors = 0;
+    bench.slow_us = slow_us;
+    bench.samples = 0;
+}
+
+// Until the callbacks have seen `sent` or it's clearly stuck
+static void bench_drain(uint32_t sent) {
+    int64_t start = esp_timer_get_time();
+    while (bench.next < sent && esp_timer_get_time() - start < 2000000) usleep(100);
+}
+
+static int bench_compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static bool bench_result(const char *test, uint32_t sent, const i2c_slave_rx_stats_t *before) {
+    i2c_slave_rx_stats_t stats;
+    i2cSlaveGetRxStats(BENCH_PORT, &stats);
+    uint32_t dispatches = stats.dispatches - before->dispatches;
+    uint32_t lost = stats.lost - before->lost;
+    bool ok = bench.errors == 0 && bench.next == sent && lost == 0;
+    printf("  %s: %u sent, %u dispatched, %u stretches, %u bytes lost, %u errors: %s\n", test, sent, dispatches,
+           stats.stretches - before->stretches, lost, bench.errors, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static void bench_latency_report(void) {
+    if (!bench.samples) return;
+    qsort(bench.dispatch_us, bench.samples, sizeof(uint32_t), bench_compare_u32);
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < bench.samples; i++) total += bench.dispatch_us[i];
+    printf("    STOP to dispatch: mean %.1f us, median %u us, p99 %u us, max %u us\n", (double)total / bench.samples,
+           bench.dispatch_us[bench.samples / 2], bench.dispatch_us[bench.samples * 99 / 100],
+           bench.dispatch_us[bench.samples - 1]);
+}
+
+static bool bench_latency(int writes, size_t len) {
+    uint8_t buf[BENCH_RX_LEN];
+    i2c_slave_rx_stats_t before;
+    i2cSlaveGetRxStats(BENCH_PORT, &before);
+    host_i2c_hw_stats_t hw_before, hw;
+    host_i2c_hw_get_stats(&I2C0, &hw_before);
+    bench_reset(0);
+    for (int i = 0; i < writes; i++) {
+        bench_fill(buf, BENCH_WRITE, i, len);
+        host_i2c_hw_write(&I2C0, buf, len);
+        bench_drain(i + 1);
+        usleep(200);
+    }
+    host_i2c_hw_get_stats(&I2C0, &hw);
+    char test[32];
+    snprintf(test, sizeof(test), "latency, %u bytes", (unsigned)len);
+    bool ok = bench_result(test, writes, &before);
+    bench_latency_report();
+    printf("    interrupt handler: %.2f us a write in %.1f calls\n", (hw.interrupt_ns - hw_before.interrupt_ns) / 1000.0 / writes,
+           (double)(hw.interrupts - hw_before.interrupts) / writes);
+    return ok;
+}
+
+static bool bench_backpressure(int writes, size_t min, size_t max, uint32_t slow_us) {
+    static uint8_t buf[BENCH_RX_LEN];
+    i2c_slave_rx_stats_t before;
+    i2cSlaveGetRxStats(BENCH_PORT, &before);
+    host_i2c_hw_stats_t hw_before, hw;
+    host_i2c_hw_get_stats(&I2C0, &hw_before);
+    bench_reset(slow_us);
+    size_t bytes = 0;
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < writes; i++) {
+        size_t len = bench_len(i, min, max);
+        bench_fill(buf, BENCH_WRITE, i, len);
+        host_i2c_hw_write(&I2C0, buf, len);
+        bytes += len;
+    }
+    bench_drain(writes);
+    int64_t elapsed = esp_timer_get_time() - start;
+    host_i2c_hw_get_stats(&I2C0, &hw);
+    bool ok = bench_result("backpressure", writes, &before);
+    printf("    %u bytes in %lld us, SCL held %u times for a full FIFO, longest %u us, %u timeouts\n", (unsigned)bytes,
+           (long long)elapsed, hw.stretches[2] - hw_before.stretches[2], hw.stretch_us_max, hw.timeouts - hw_before.timeouts);
+    return ok && hw.timeouts == hw_before.timeouts;
+}
+
+// Each round queues `queued` long writes then reads behind them
+static bool bench_reads(int rounds, int queued, size_t len, uint32_t slow_us) {
+    static uint8_t buf[BENCH_RX_LEN];
+    i2c_slave_rx_stats_t before;
+    i2cSlaveGetRxStats(BENCH_PORT, &before);
+    host_i2c_hw_stats_t hw_before, hw;
+    host_i2c_hw_get_stats(&I2C0, &hw_before);
+    bench_reset(slow_us);
+    uint32_t seq = 0, bad_replies = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < queued; i++, seq++) {
+            bench_fill(buf, BENCH_WRITE, seq, len);
+            host_i2c_hw_write(&I2C0, buf, len);
+        }
+        uint8_t cmd[BENCH_HEADER], reply[BENCH_REPLY];
+        bench_fill(cmd, BENCH_READ, seq, sizeof(cmd));
+        if (host_i2c_hw_write_read(&I2C0, cmd, sizeof(cmd), reply, sizeof(reply)) < 0) {
+            bad_replies++;
+        } else {
+            for (int i = 0; i < BENCH_REPLY; i++) {
+                if (reply[i] != (uint8_t)(seq * 7 + i)) {
+                    bad_replies++;
+                    break;
+                }
+            }
+        }
+        seq++;
+    }
+    bench_drain(seq);
+    host_i2c_hw_get_stats(&I2C0, &hw);
+    bool ok = bench_result("reads", seq, &before);
+    printf("    %d reads, %u bad replies, %u TX FIFO underflows, %u timeouts\n", rounds, bad_replies,
+           hw.underflows - hw_before.underflows, hw.timeouts - hw_before.timeouts);
+    return ok && bad_replies == 0 && hw.timeouts == hw_before.timeouts;
+}
+
+int main(int argc, char **argv) {
+    int writes = 2000;
+    uint32_t hz = 400000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:k:h")) != -1) {
+        switch (opt) {
+            case 'n': writes = atoi(optarg); break;
+            case 'k': hz = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: %s [-n writes] [-k bus Hz]\n", argv[0]);
+                return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (writes < 10) writes = 10;
+
+    bench.max_samples = writes;
+    bench.dispatch_us = calloc(writes, sizeof(uint32_t));
+    host_i2c_hw_set_hz(&I2C0, hz);
+    i2cSlaveAttachCallbacks(BENCH_PORT, bench_request, bench_receive, NULL);
+    if (i2cSlaveInit(BENCH_PORT, 1, 2, BENCH_ADDR, hz, BENCH_RX_LEN, BENCH_TX_LEN) != ESP_OK) {
+        fprintf(stderr, "i2cSlaveInit failed\n");
+        return 1;
+    }
+
+    printf("I2C slave, %s receive path, %u Hz\n", I2C_SLAVE_FAST_RX ? "slot" : "ring buffer", hz);
+    bool ok = bench_latency(writes, 16);
+    ok &= bench_latency(writes / 4, 256);
+    // callbacks slower than the writes take on the wire, so the slots or the ring fill
+    ok &= bench_backpressure(writes / 20, 64, BENCH_RX_LEN / 2, 20000);
+    ok &= bench_reads(writes / 40, 6, 64, 5000);
+    i2cSlaveDeinit(BENCH_PORT);
+    free(bench.dispatch_us);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,255 @@
+// host_i2s.c
+// File backed I2S channels for the host build.
+// The simulated DMA drains TX and fills RX at the configured sample rate (unless
+// free running), so a render that misses its block deadline shows up as an
+// underrun exactly like it would on the chip.
+// With an on_sent callback registered, TX runs a descriptor ring on its own
+// thread instead, handing each sent buffer back like the DMA interrupt does.
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "host_idf.h"
+
+struct host_i2s_chan {
+    int is_tx;
+    int enabled;
+    uint32_t sample_rate;
+    uint32_t frame_bytes;
+    uint32_t dma_frames;       // dma_desc_num * dma_frame_num
+    int64_t t0_us;             // when frame 0 of this channel was clocked
+    uint64_t frames;           // frames written to / read from the DMA so far
+    FILE *file;
+    uint32_t dma_desc_num;
+    uint32_t dma_frame_num;
+    bool auto_clear;
+    i2s_event_callbacks_t callbacks;
+    void *user_data;
+    uint8_t **dma_bufs;        // descriptor ring, only with callbacks
+    pthread_t dma_thread;
+};
+
+static struct host_i2s_chan host_tx = { .is_tx = 1 };
+static struct host_i2s_chan host_rx = { .is_tx = 0 };
+
+// Render timing: on the task that reads the input, the time from a read
+// returning to that task's next I2S call is what it spent rendering the block.
+// That works with the write on the same task or on a pipeline task. With the
+// input unused, the writing task is timed from its last write instead.
+static __thread int64_t last_io_return_us = 0;
+static __thread int last_io_was_read = 0;
+static volatile int input_used = 0;
+static uint64_t blocks = 0;
+static uint64_t blocks_late = 0;
+static uint64_t underruns = 0;
+static int64_t render_us_total = 0;
+static int64_t render_us_max = 0;
+static int64_t deadline_us = 0;
+static FILE *block_log = NULL;
+
+static void host_i2s_time_block(uint32_t frames, uint32_t sample_rate) {
+    int64_t now = esp_timer_get_time();
+    if (last_io_return_us == 0 || (!last_io_was_read && input_used)) return;
+    int64_t render_us = now - last_io_return_us;
+    deadline_us = (int64_t)((uint64_t)frames * 1000000ULL / sample_rate);
+    render_us_total += render_us;
+    if (render_us > render_us_max) render_us_max = render_us;
+    if (render_us > deadline_us) blocks_late++;
+    if (block_log) fprintf(block_log, "%llu,%lld,%lld\n", (unsigned long long)blocks, (long long)render_us, (long long)deadline_us);
+    blocks++;
+}
+
+static void host_i2s_io_returned(int was_read) {
+    last_io_return_us = esp_timer_get_time();
+    last_io_was_read = was_read;
+    if (was_read) input_used = 1;
+}
+
+static uint64_t host_i2s_clocked_frames(struct host_i2s_chan *c, int64_t now) {
+    return (uint64_t)((now - c->t0_us) * (int64_t)c->sample_rate / 1000000LL);
+}
+
+static void host_i2s_wait_frames(struct host_i2s_chan *c, uint64_t frames) {
+    int64_t due_us = c->t0_us + (int64_t)(frames * 1000000ULL / c->sample_rate);
+    int64_t now = esp_timer_get_time();
+    if (due_us > now) {
+        usleep((useconds_t)(due_us - now));
+    }
+}
+
+static void host_i2s_set_dma(struct host_i2s_chan *c, const i2s_chan_config_t *chan_cfg) {
+    c->dma_desc_num = chan_cfg->dma_desc_num;
+    c->dma_frame_num = chan_cfg->dma_frame_num;
+    c->dma_frames = chan_cfg->dma_desc_num * chan_cfg->dma_frame_num;
+    c->auto_clear = chan_cfg->auto_clear;
+}
+
+esp_err_t i2s_new_channel(const i2s_chan_config_t *chan_cfg, i2s_chan_handle_t *ret_tx_handle, i2s_chan_handle_t *ret_rx_handle) {
+    if (ret_tx_handle) {
+        host_i2s_set_dma(&host_tx, chan_cfg);
+        *ret_tx_handle = &host_tx;
+    }
+    if (ret_rx_handle) {
+        host_i2s_set_dma(&host_rx, chan_cfg);
+        *ret_rx_handle = &host_rx;
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_register_event_callback(i2s_chan_handle_t handle, const i2s_event_callbacks_t *callbacks, void *user_data) {
+    if (handle->enabled) return ESP_ERR_INVALID_STATE;
+    handle->callbacks = *callbacks;
+    handle->user_data = user_data;
+    return ESP_OK;
+}
+
+// The TX descriptor ring: every buffer period the current buffer goes out
+// (to the output file), is cleared if auto_clear and handed back through on_sent.
+static void *host_i2s_dma_thread(void *arg) {
+    struct host_i2s_chan *c = (struct host_i2s_chan *)arg;
+    size_t buf_bytes = c->dma_frame_num * c->frame_bytes;
+    uint32_t desc = 0;
+    while (c->enabled) {
+        if (!host_config.free_run) {
+            host_i2s_wait_frames(c, c->frames + c->dma_frame_num);
+        }
+        if (c->file) fwrite(c->dma_bufs[desc], 1, buf_bytes, c->file);
+        if (c->auto_clear) memset(c->dma_bufs[desc], 0, buf_bytes);
+        c->frames += c->dma_frame_num;
+        i2s_event_data_t event = { .data = &c->dma_bufs[desc], .dma_buf = c->dma_bufs[desc], .size = buf_bytes };
+        c->callbacks.on_sent(c, &event, c->user_data);
+        desc = (desc + 1) % c->dma_desc_num;
+        if (host_config.free_run) usleep(1);
+    }
+    return NULL;
+}
+
+esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle, const i2s_std_config_t *std_cfg) {
+    handle->sample_rate = std_cfg->clk_cfg.sample_rate_hz;
+    handle->frame_bytes = (std_cfg->slot_cfg.data_bit_width / 8) * std_cfg->slot_cfg.slot_mode;
+    const char *path = handle->is_tx ? host_config.audio_out_path : host_config.audio_in_path;
+    if (path && handle->file == NULL) {
+        handle->file = fopen(path, handle->is_tx ? "wb" : "rb");
+        if (handle->file == NULL) {
+            ESP_LOGE("host_i2s", "can't open %s", path);
+            return ESP_FAIL;
+        }
+    }
+    if (handle->is_tx && host_config.block_log_path && block_log == NULL) {
+        block_log = fopen(host_config.block_log_path, "w");
+        if (block_log) fprintf(block_log, "block,render_us,deadline_us\n");
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle) {
+    handle->enabled = 1;
+    handle->t0_us = esp_timer_get_time();
+    handle->frames = 0;
+    if (handle->is_tx && handle->callbacks.on_sent) {
+        if (handle->dma_bufs == NULL) {
+            handle->dma_bufs = calloc(handle->dma_desc_num, sizeof(uint8_t *));
+            for (uint32_t i = 0; i < handle->dma_desc_num; i++) {
+                handle->dma_bufs[i] = calloc(handle->dma_frame_num, handle->frame_bytes);
+            }
+        }
+        pthread_create(&handle->dma_thread, NULL, host_i2s_dma_thread, handle);
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle) {
+    handle->enabled = 0;
+    // with capture off the writing task is timed again
+    if (!handle->is_tx) input_used = 0;
+    if (handle->is_tx && handle->callbacks.on_sent) {
+        pthread_join(handle->dma_thread, NULL);
+    }
+    return ESP_OK;
+}
+
+// The channels are static; deleting one drops its DMA ring and callbacks but
+// keeps the audio file open so a reconfigured channel carries on where it was.
+esp_err_t i2s_del_channel(i2s_chan_handle_t handle) {
+    if (handle->enabled) return ESP_ERR_INVALID_STATE;
+    if (handle->dma_bufs) {
+        for (uint32_t i = 0; i < handle->dma_desc_num; i++) free(handle->dma_bufs[i]);
+        free(handle->dma_bufs);
+        handle->dma_bufs = NULL;
+    }
+    memset(&handle->callbacks, 0, sizeof(handle->callbacks));
+    handle->user_data = NULL;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_read(i2s_chan_handle_t handle, void *dest, size_t size, size_t *bytes_read, uint32_t timeout_ms) {
+    if (!handle->enabled) {
+        if (bytes_read) *bytes_read = 0;
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint64_t n = size / handle->frame_bytes;
+    host_i2s_time_block(n, handle->sample_rate);
+    if (!host_config.free_run) {
+        uint64_t clocked = host_i2s_clocked_frames(handle, esp_timer_get_time());
+        // The RX DMA ring overwrites what nobody picked up in time
+        if (clocked > handle->frames + handle->dma_frames) {
+            handle->frames = clocked - handle->dma_frames;
+        }
+        host_i2s_wait_frames(handle, handle->frames + n);
+    }
+    size_t got = 0;
+    if (handle->file) {
+        got = fread(dest, 1, size, handle->file);
+    }
+    memset((uint8_t *)dest + got, 0, size - got);
+    handle->frames += n;
+    if (bytes_read) *bytes_read = size;
+    host_i2s_io_returned(1);
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_write(i2s_chan_handle_t handle, const void *src, size_t size, size_t *bytes_written, uint32_t timeout_ms) {
+    if (!handle->enabled) {
+        if (bytes_written) *bytes_written = 0;
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint64_t n = size / handle->frame_bytes;
+    host_i2s_time_block(n, handle->sample_rate);
+    int64_t now = esp_timer_get_time();
+    if (!host_config.free_run) {
+        if (handle->frames == 0) {
+            // The DMA starts clocking out with the first block
+            handle->t0_us = now;
+        }
+        uint64_t clocked = host_i2s_clocked_frames(handle, now);
+        if (clocked > handle->frames) {
+            // The DMA ran dry before this block arrived: restart the clock from here
+            underruns++;
+            if (handle->callbacks.on_send_q_ovf) {
+                i2s_event_data_t event = { 0 };
+                handle->callbacks.on_send_q_ovf(handle, &event, handle->user_data);
+            }
+            handle->t0_us = now - (int64_t)(handle->frames * 1000000ULL / handle->sample_rate);
+        }
+        if (handle->frames + n > handle->dma_frames) {
+            host_i2s_wait_frames(handle, handle->frames + n - handle->dma_frames);
+        }
+    }
+    if (handle->file) {
+        fwrite(src, 1, size, handle->file);
+    }
+    handle->frames += n;
+    if (bytes_written) *bytes_written = size;
+    host_i2s_io_returned(0);
+    return ESP_OK;
+}
+
+void host_i2s_report(FILE *f) {
+    if (block_log) fflush(block_log);
+    if (host_tx.file) fflush(host_tx.file);
+    fprintf(f, "i2s: %llu blocks, deadline %lld us/block, render avg %lld us max %lld us, %llu late (%.2f%%), %llu underruns%s\n",
+            (unsigned long long)blocks, (long long)deadline_us,
+            (long long)(blocks ? render_us_total / (int64_t)blocks : 0), (long long)render_us_max,
+            (unsigned long long)blocks_late, blocks ? 100.0 * blocks_late / blocks : 0.0,
+            (unsigned long long)underruns, host_config.free_run ? " (free running)" : "");
+}
@@ -0,0 +1,42 @@
+// host_irq.c
+// The interrupt line for the host build: no pin, just a record of when it was
+// asserted and for how long, i.e. how long events waited for the host to read them.
+
+#include "host_idf.h"
+#include "amychip_irq.h"
+
+static int asserted = 0;
+static int64_t asserted_at_us = 0;
+static uint32_t asserts = 0;
+static int64_t asserted_us_total = 0;
+static int64_t asserted_us_max = 0;
+
+static esp_err_t host_irq_init(int gpio) {
+    ESP_LOGI("host_irq", "interrupt line on simulated GPIO %d", gpio);
+    return ESP_OK;
+}
+
+static void host_irq_set(int gpio, bool on) {
+    int64_t now = esp_timer_get_time();
+    if (on && !asserted) {
+        asserts++;
+        asserted_at_us = now;
+    } else if (!on && asserted) {
+        int64_t us = now - asserted_at_us;
+        asserted_us_total += us;
+        if (us > asserted_us_max) asserted_us_max = us;
+    }
+    asserted = on;
+}
+
+const amychip_irq_line_t host_irq_line = {
+    .init = host_irq_init,
+    .set = host_irq_set,
+};
+
+void host_irq_report(FILE *f) {
+    fprintf(f, "irq line: asserted %u times%s, avg %lld us max %lld us until read; %u events posted, %u dropped, %u waiting\n",
+            asserts, asserted ? " (still asserted)" : "",
+            (long long)(asserts ? asserted_us_total / asserts : 0), (long long)asserted_us_max,
+            amychip_irq_posted(), amychip_irq_drops(), amychip_irq_pending());
+}
@@ -0,0 +1,155 @@
+// host_main.c
+// Entry point for the host (Linux) build of amychip. Runs app_main() from
+// amychip.c like the IDF main task would, lets it play for a while and then
+// reports how the render kept up with the I2S block deadline.
+
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "host_idf.h"
+#include "amychip.h"
+#include "amychip_uart.h"
+#include "wm8960.h"
+#include "amychip_codec.h"
+
+extern void app_main(void);
+extern void host_wire_bench(FILE *f, int messages);
+extern void host_transport_bench(FILE *f, int messages);
+
+host_config_t host_config = { .spi_hz = 20000000 };
+
+void esp_chip_info(esp_chip_info_t *out_info) {
+    memset(out_info, 0, sizeof(esp_chip_info_t));
+    out_info->cores = 2;
+}
+
+esp_err_t esp_flash_get_size(esp_flash_t *chip, uint32_t *out_size) {
+    *out_size = 8 * 1024 * 1024;
+    return ESP_OK;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return 0;
+}
+
+// No PSRAM on the host
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return 0;
+}
+
+// The ROM's little endian CRC-32, the same one as zlib's crc32()
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++) crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static void host_app_main_task(void *pv_args) {
+    app_main();
+    vTaskDelete(NULL);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "usage: %s [-s seconds] [-i in.raw] [-o out.raw] [-m messages|-] [-p messages|-] [-k hz] [-u messages|-] [-c codec.log] [-b blocks.csv] [-f] [-w messages] [-t messages]\n"
+        "  -s  run for this many seconds (default 10)\n"
+        "  -i  audio input, raw s16le stereo (default silence)\n"
+        "  -o  audio output, raw s16le stereo (default discarded)\n"
+        "  -m  I2C messages, one write per line, file or fifo, - for stdin\n"
+        "  -p  SPI messages, one transaction per line, file or fifo, - for stdin\n"
+        "  -k  SPI master clock in Hz (default 20000000)\n"
+        "  -u  UART messages, one frame per line, file or fifo, - for stdin\n"
+        "  -c  log the codec register writes here\n"
+        "  -b  write per-block render time and deadline as CSV\n"
+        "  -f  free run: don't pace I2S to the sample clock\n"
+        "  -w  compare the ASCII and binary wire formats over this many messages and exit\n"
+        "  -t  send this many messages over I2C, SPI and UART, report how fast each got them in, and exit\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    int seconds = 10;
+    int bench_messages = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:i:o:m:p:k:u:c:b:fw:t:h")) != -1) {
+        switch (opt) {
+            case 's': seconds = atoi(optarg); break;
+            case 'i': host_config.audio_in_path = optarg; break;
+            case 'o': host_config.audio_out_path = optarg; break;
+            case 'm': host_config.messages_path = optarg; break;
+            case 'p': host_config.spi_messages_path = optarg; break;
+            case 'k': host_config.spi_hz = atoi(optarg); break;
+            case 'u': host_config.uart_messages_path = optarg; break;
+            case 'c': host_config.codec_log_path = optarg; break;
+            case 'b': host_config.block_log_path = optarg; break;
+            case 'f': host_config.free_run = 1; break;
+            case 'w': host_wire_bench(stdout, atoi(optarg)); return 0;
+            case 't': bench_messages = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    esp_timer_get_time();
+    xTaskCreate(host_app_main_task, "main", 8192, NULL, 1, NULL);
+    if (bench_messages > 0) {
+        // let the firmware come up first
+        usleep(500000);
+        host_transport_bench(stdout, bench_messages);
+        return 0;
+    }
+    sleep(seconds);
+    fflush(stdout);
+    host_i2s_report(stderr);
+    host_i2c_report(stderr);
+    fprintf(stderr, "codec: init %u us, %u register writes\n", esp_get_codec_init_us(), wm8960_get_writes());
+    amychip_codec_stats_t codec;
+    amychip_codec_get_stats(&codec);
+    fprintf(stderr, "codec queue: %u writes, %u merged, %u dropped, %u sent (%u failed), %u waiting, high water %u\n",
+            codec.queued, codec.merged, codec.dropped, codec.sent, codec.errors, codec.pending, codec.high_water);
+    host_irq_report(stderr);
+    host_spi_report(stderr);
+    host_uart_report(stderr);
+    amychip_uart_stats_t uart;
+    amychip_uart_get_stats(&uart);
+    fprintf(stderr, "uart: %u frames, %u bytes (%u bytes/s last second), %u bad frames, %u line errors, %u overflows\n",
+            uart.frames, uart.bytes, uart.bytes_per_s, uart.frame_errors, uart.line_errors, uart.overflows);
+    amychip_balance_t balance;
+    esp_get_render_balance(&balance);
+    fprintf(stderr, "render split at osc %u: core 0 %u oscs %u us (predicted %u), core 1 %u oscs %u us (predicted %u)\n",
+            balance.split, balance.active_oscs[0], balance.render_us[0], balance.predicted_us[0],
+            balance.active_oscs[1], balance.render_us[1], balance.predicted_us[1]);
+    fprintf(stderr, "output pipeline: render ahead %u of %u buffers (%u ready, %u us), latency profile %u, %u us from render to DAC, %u late DMA blocks\n",
+            esp_get_render_ahead(), esp_get_pipeline_depth(), esp_get_render_ahead_ready(), esp_get_render_ahead_latency_us(),
+            esp_get_latency_profile(), esp_get_output_latency_us(), esp_get_dma_late_blocks());
+    amychip_ring_info_t ring;
+    esp_get_command_ring(&ring);
+    fprintf(stderr, "command ring: %u messages, %u dropped, %u of %u bytes waiting, high water %u\n",
+            ring.pushed, ring.drops, ring.used, ring.size, ring.high_water);
+    uint32_t batched, spanned, batch_errors;
+    esp_get_batch_stats(&batched, &spanned, &batch_errors);
+    fprintf(stderr, "batches: %u messages, %u split across writes, %u lost\n", batched, spanned, batch_errors);
+    amychip_upload_t upload;
+    esp_get_upload(&upload);
+    fprintf(stderr, "upload: state %u, patch %u, %u of %u bytes in %u chunks (%u bytes/s), %u bad crc, %u bad offset\n",
+            upload.state, upload.patch, upload.received, upload.size, upload.chunks, amychip_upload_rate(&upload),
+            upload.bad_crc, upload.bad_offset);
+    amychip_stats_t stats;
+    amychip_stats_get(&stats);
+    fprintf(stderr, "amychip stats: %u blocks, %u underruns, %u short reads, %u short writes, render last %u max %u of %u us, "
+            "waited %u ms on input, %u ms on output\n",
+            stats.blocks, stats.underruns, stats.short_reads, stats.short_writes, stats.render_us_last,
+            stats.render_us_max, stats.deadline_us, stats.read_wait_ms, stats.write_wait_ms);
+    fprintf(stderr, "messages: %u ascii, %u bytes, %u us to play; %u binary, %u bytes, %u us to play, %u bad\n",
+            stats.ascii_messages, stats.ascii_bytes, stats.ascii_us,
+            stats.binary_messages, stats.binary_bytes, stats.binary_us, stats.wire_errors);
+    fprintf(stderr, "scheduled: %u played, %u late, %u refused; sample clock %u\n",
+            stats.sched_messages, stats.sched_late, stats.sched_drops, esp_get_sample_clock());
+    fprintf(stderr, "audio input off for %u blocks\n", stats.input_off_blocks);
+    fprintf(stderr, "shedding (policy %u): %u oscs stopped over %u blocks, effects muted for %u blocks\n",
+            esp_get_shed_policy(), stats.shed_oscs, stats.shed_blocks, stats.effects_shed_blocks);
+    fprintf(stderr, "render time histogram, eighths of the deadline:");
+    for (int i = 0; i < AMYCHIP_RENDER_HIST_BINS; i++) fprintf(stderr, " %u", stats.render_hist[i]);
+    fprintf(stderr, "\n");
+    return 0;
+}
@@ -0,0 +1,109 @@
+// host_spi.c
+// SPI slave driver stand-in for the host build, with a simulated master.
+// The master takes each line of the SPI messages file (same format as the I2C
+// one, see host_i2c.c) as one transaction, clocks it into the next
+// transaction the slave has queued at host_config.spi_hz and completes it.
+// A real master has no way to know whether the slave has a buffer queued; if
+// it hasn't, those bytes would be lost. Here the master waits and counts it.
+
+#include <string.h>
+#include <unistd.h>
+#include "host_idf.h"
+
+static const char *TAG = "host_spi";
+
+static QueueHandle_t spi_queued = NULL;  // transactions the slave has handed the driver
+static QueueHandle_t spi_done = NULL;    // finished, for spi_slave_get_trans_result
+static TaskHandle_t spi_master_handle = NULL;
+static uint32_t spi_transactions = 0;
+static uint32_t spi_bytes = 0;
+static uint32_t spi_truncated = 0;
+static uint32_t spi_no_buffer = 0;
+static int64_t spi_wire_us = 0;
+
+static int64_t host_spi_wire_us(size_t bytes) {
+    return (int64_t)bytes * 8 * 1000000LL / host_config.spi_hz;
+}
+
+void host_spi_master_transfer(const uint8_t *data, size_t len) {
+    spi_slave_transaction_t *t;
+    if (xQueueReceive(spi_queued, &t, 0) != pdTRUE) {
+        spi_no_buffer++;
+        xQueueReceive(spi_queued, &t, portMAX_DELAY);
+    }
+    int64_t wire_us = host_spi_wire_us(len);
+    usleep((useconds_t)wire_us);
+    spi_wire_us += wire_us;
+    size_t n = len;
+    if (n > t->length / 8) {
+        n = t->length / 8;
+        spi_truncated++;
+    }
+    memcpy(t->rx_buffer, data, n);
+    t->trans_len = n * 8;
+    spi_transactions++;
+    spi_bytes += n;
+    // CS goes high; the slave task picks it up while the next one clocks in
+    xQueueSend(spi_done, &t, portMAX_DELAY);
+}
+
+static void host_spi_master_task(void *pv_args) {
+    FILE *in = strcmp(host_config.spi_messages_path, "-") ? fopen(host_config.spi_messages_path, "r") : stdin;
+    if (in == NULL) {
+        ESP_LOGE(TAG, "can't open %s", host_config.spi_messages_path);
+        vTaskDelete(NULL);
+    }
+    int64_t start_us = esp_timer_get_time();
+    static char line[16384];
+    static uint8_t data[8192];
+    while (fgets(line, sizeof(line), in)) {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = 0;
+        if (len == 0 || line[0] == '#') continue;
+        if (line[0] == '@') {
+            int64_t due_us = start_us + atoll(line + 1) * 1000LL;
+            int64_t now = esp_timer_get_time();
+            if (due_us > now) usleep((useconds_t)(due_us - now));
+            continue;
+        }
+        if (line[0] == '!') {
+            len = host_parse_hex(line + 1, data, sizeof(data));
+        } else {
+            if (len > sizeof(data)) len = sizeof(data);
+            memcpy(data, line, len);
+        }
+        host_spi_master_transfer(data, len);
+    }
+    if (in != stdin) fclose(in);
+    spi_master_handle = NULL;
+    vTaskDelete(NULL);
+}
+
+esp_err_t spi_slave_initialize(spi_host_device_t host, const spi_bus_config_t *bus_config,
+                               const spi_slave_interface_config_t *slave_config, int dma_chan) {
+    ESP_LOGI(TAG, "Initialising SPI slave: %d queued transactions, %u Hz master, messages from %s",
+             slave_config->queue_size, host_config.spi_hz,
+             host_config.spi_messages_path ? host_config.spi_messages_path : "(none)");
+    spi_queued = xQueueCreate(slave_config->queue_size, sizeof(spi_slave_transaction_t *));
+    spi_done = xQueueCreate(slave_config->queue_size, sizeof(spi_slave_transaction_t *));
+    if (spi_queued == NULL || spi_done == NULL) return ESP_ERR_NO_MEM;
+    if (host_config.spi_messages_path) {
+        if (xTaskCreate(host_spi_master_task, "spi_master_task", 8192, NULL, 20, &spi_master_handle) != pdPASS) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t spi_slave_queue_trans(spi_host_device_t host, const spi_slave_transaction_t *trans_desc, TickType_t ticks_to_wait) {
+    return xQueueSend(spi_queued, &trans_desc, ticks_to_wait) == pdTRUE ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t spi_slave_get_trans_result(spi_host_device_t host, spi_slave_transaction_t **trans_desc, TickType_t ticks_to_wait) {
+    return xQueueReceive(spi_done, trans_desc, ticks_to_wait) == pdTRUE ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+void host_spi_report(FILE *f) {
+    fprintf(f, "spi master: %u transactions, %u bytes, %lld us on the wire, %u truncated, %u found no buffer queued\n",
+            spi_transactions, spi_bytes, (long long)spi_wire_us, spi_truncated, spi_no_buffer);
+}
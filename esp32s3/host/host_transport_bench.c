@@ -0,0 +1,149 @@
+// host_transport_bench.c
+// Pushes the same stream of AMY messages through each of the running firmware's
+// control transports, batched into the biggest writes each takes, and reports
+// how fast they reach the message queue. Over I2C the simulated master spends
+// the credits it reads back from the chip and asks again when they run out;
+// SPI and UART have no way back yet, so there it looks at the queue directly.
+// Either way nothing should be dropped and the block rate's drain shows up as a limit.
+
+#include <string.h>
+#include <unistd.h>
+#include "host_idf.h"
+#include "amychip.h"
+#include "amychip_protocol.h"
+#include "amychip_batch.h"
+#include "amychip_ring.h"
+#include "amychip_spi.h"
+#include "amychip_uart.h"
+#include "amychip_cobs.h"
+
+#define BENCH_I2C_WRITE 2048  // I2C_SLAVE_MAX_WRITE
+#define BENCH_I2C_HZ 400000   // I2C_CLK_FREQ
+
+typedef struct {
+    const char *name;
+    size_t max_write;
+    void (*send)(const uint8_t *data, size_t len);
+    int64_t (*receive_us)(void);
+    int64_t (*wire_us)(size_t bytes);
+    uint32_t (*credits)(void);  // NULL: no read path, look at the queue
+} bench_transport_t;
+
+// AMYCHIP_CMD_CREDITS as a write-then-read
+static uint32_t bench_i2c_credits(void) {
+    uint8_t cmd = AMYCHIP_CMD_CREDITS, reply[8];
+    if (host_i2c_master_read(&cmd, 1, reply, sizeof(reply)) < 4) return 0;
+    return reply[0] | (reply[1] << 8) | (reply[2] << 16) | ((uint32_t)reply[3] << 24);
+}
+
+static int64_t bench_uart_receive_us(void) {
+    amychip_uart_stats_t stats;
+    amychip_uart_get_stats(&stats);
+    return stats.receive_us;
+}
+
+static int64_t bench_spi_receive_us(void) {
+    amychip_spi_stats_t stats;
+    amychip_spi_get_stats(&stats);
+    return stats.receive_us;
+}
+
+// START + address + data, 9 clocks a byte, STOP
+static int64_t bench_i2c_wire_us(size_t bytes) {
+    return (int64_t)(bytes + 1) * 9 * 1000000LL / BENCH_I2C_HZ + 1000000LL / BENCH_I2C_HZ;
+}
+
+static int64_t bench_spi_wire_us(size_t bytes) {
+    return (int64_t)bytes * 8 * 1000000LL / host_config.spi_hz;
+}
+
+static int64_t bench_uart_wire_us(size_t bytes) {
+    return host_uart_wire_us(AMYCHIP_COBS_ENCODED_MAX(bytes));
+}
+
+static uint32_t bench_queued(void) {
+    amychip_ring_info_t ring;
+    esp_get_command_ring(&ring);
+    return ring.pushed + ring.drops;
+}
+
+// Wait until the messages sent so far are on the queue and it has room for this much more
+static int64_t bench_wait_for_room(const bench_transport_t *t, uint32_t *credits, uint32_t queued, uint32_t bytes) {
+    int64_t start = esp_timer_get_time();
+    if (t->credits) {
+        while (*credits < bytes) {
+            *credits = t->credits();
+            if (*credits < bytes) usleep(100);
+        }
+        *credits -= bytes;
+        return esp_timer_get_time() - start;
+    }
+    while (bench_queued() < queued) usleep(10);
+    amychip_ring_info_t ring;
+    for (esp_get_command_ring(&ring); ring.size - ring.used < bytes; esp_get_command_ring(&ring)) usleep(100);
+    return esp_timer_get_time() - start;
+}
+
+static void bench_run(FILE *f, const bench_transport_t *t, int messages) {
+    static uint8_t write[AMYCHIP_SPI_MAX_TRANSFER];
+    char message[32];
+    size_t fill = 0;
+    uint32_t queue_bytes = 0, writes = 0, bytes = 0, credits = 0;
+    int64_t wire_us = 0, waited_us = 0;
+    amychip_ring_info_t ring;
+    esp_get_command_ring(&ring);
+    uint32_t drops_before = ring.drops;
+    uint32_t sent = bench_queued(), in_write = 0;
+    uint32_t target = sent + messages;
+    int64_t receive_before = t->receive_us();
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i <= messages; i++) {
+        size_t len = 0;
+        if (i < messages) {
+            uint16_t osc = i % 64;
+            len = (i % 2) ? snprintf(message, sizeof(message), "v%uF%gR%g", osc, 200.0f + (i % 100) * 37.5f, 0.7f + (i % 8) * 0.5f)
+                          : snprintf(message, sizeof(message), "v%uw1n%ul%g", osc, 48 + (i * 7) % 36, 0.25f + (i % 4) * 0.25f);
+        }
+        uint8_t prefix[2];
+        size_t prefix_len = amychip_batch_prefix(prefix, len);
+        if (fill > 0 && (i == messages || fill + prefix_len + len > t->max_write)) {
+            waited_us += bench_wait_for_room(t, &credits, sent, queue_bytes);
+            t->send(write, fill);
+            wire_us += t->wire_us(fill);
+            writes++;
+            bytes += fill;
+            sent += in_write;
+            fill = 0;
+            queue_bytes = 0;
+            in_write = 0;
+        }
+        if (i == messages) break;
+        if (fill == 0) write[fill++] = AMYCHIP_CMD_BATCH;
+        memcpy(write + fill, prefix, prefix_len);
+        memcpy(write + fill + prefix_len, message, len);
+        fill += prefix_len + len;
+        queue_bytes += AMYCHIP_RING_HEADER + len;
+        in_write++;
+    }
+    // until the last message is on the queue, and then played
+    while (bench_queued() < target) usleep(100);
+    int64_t delivered_us = esp_timer_get_time() - start;
+    for (esp_get_command_ring(&ring); ring.used > 0; esp_get_command_ring(&ring)) usleep(100);
+    int64_t played_us = esp_timer_get_time() - start;
+    int64_t receive_us = t->receive_us() - receive_before;
+    fprintf(f, "%s: %d messages in %u writes, %u bytes, %lld us on the wire\n", t->name, messages, writes, bytes, (long long)wire_us);
+    fprintf(f, "  queued in %lld us (%.0f messages/s, %.1f KB/s), played by %lld us, %lld us waiting for %s, %u dropped\n",
+            (long long)delivered_us, messages * 1e6 / delivered_us, bytes * 1e6 / 1024.0 / delivered_us,
+            (long long)played_us, (long long)waited_us, t->credits ? "credits" : "queue room", ring.drops - drops_before);
+    fprintf(f, "  receive path %lld us, %.2f us per message\n", (long long)receive_us, (double)receive_us / messages);
+}
+
+void host_transport_bench(FILE *f, int messages) {
+    const bench_transport_t i2c = { "i2c", BENCH_I2C_WRITE, host_i2c_master_write, host_i2c_receive_us, bench_i2c_wire_us, bench_i2c_credits };
+    const bench_transport_t spi = { "spi", AMYCHIP_SPI_MAX_TRANSFER, host_spi_master_transfer, bench_spi_receive_us, bench_spi_wire_us, NULL };
+    const bench_transport_t uart = { "uart", AMYCHIP_COBS_MAX_FRAME, host_uart_send_frame, bench_uart_receive_us, bench_uart_wire_us, NULL };
+    fprintf(f, "i2c at %u Hz, spi at %u Hz, uart at %lld bytes/s\n", BENCH_I2C_HZ, host_config.spi_hz, 1000000LL / host_uart_wire_us(1));
+    bench_run(f, &i2c, messages);
+    if (amychip_spi_running()) bench_run(f, &spi, messages);
+    if (amychip_uart_running()) bench_run(f, &uart, messages);
+}
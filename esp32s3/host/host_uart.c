@@ -0,0 +1,169 @@
+// host_uart.c
+// UART driver stand-in for the host build, with a simulated sender on the
+// other end of the line. The sender takes each line of the UART messages file
+// (same format as the I2C one, see host_i2c.c) as one frame, COBS encodes it
+// and clocks it out at the baud rate the firmware configured, 10 bits a byte.
+// Like the driver, the bytes land in an RX ring buffer with a UART_DATA event
+// every FIFO's worth; a full ring loses bytes and posts UART_BUFFER_FULL.
+// A line "~<hex bytes>" goes out as those raw bytes with no framing, to test
+// how the receiver copes with a broken stream.
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "host_idf.h"
+#include "amychip_cobs.h"
+
+#define HOST_UART_FIFO 120  // the driver's default RX full threshold
+
+static const char *TAG = "host_uart";
+
+static pthread_mutex_t uart_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t *uart_ring = NULL;
+static size_t uart_ring_size = 0;
+static size_t uart_ring_head = 0;  // next byte to read
+static size_t uart_ring_used = 0;
+static QueueHandle_t uart_event_queue = NULL;
+static uint32_t uart_baud = 115200;
+static TaskHandle_t uart_sender_handle = NULL;
+static uint32_t sent_frames = 0;
+static uint32_t sent_bytes = 0;
+static uint32_t lost_bytes = 0;
+static int64_t uart_wire_us = 0;
+
+int64_t host_uart_wire_us(size_t bytes) {
+    return (int64_t)bytes * 10 * 1000000LL / uart_baud;
+}
+
+static void host_uart_post(uart_event_type_t type, size_t size) {
+    uart_event_t event = { .type = type, .size = size };
+    xQueueSend(uart_event_queue, &event, 0);
+}
+
+// Clock bytes onto the line a FIFO at a time
+static void host_uart_send_raw(const uint8_t *data, size_t len) {
+    while (len > 0) {
+        size_t n = len < HOST_UART_FIFO ? len : HOST_UART_FIFO;
+        int64_t wire_us = host_uart_wire_us(n);
+        usleep((useconds_t)wire_us);
+        uart_wire_us += wire_us;
+        pthread_mutex_lock(&uart_lock);
+        size_t room = uart_ring_size - uart_ring_used;
+        size_t take = n < room ? n : room;
+        for (size_t i = 0; i < take; i++) {
+            uart_ring[(uart_ring_head + uart_ring_used + i) % uart_ring_size] = data[i];
+        }
+        uart_ring_used += take;
+        pthread_mutex_unlock(&uart_lock);
+        sent_bytes += n;
+        if (take < n) {
+            lost_bytes += n - take;
+            host_uart_post(UART_BUFFER_FULL, 0);
+        } else {
+            host_uart_post(UART_DATA, take);
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+void host_uart_send_frame(const uint8_t *data, size_t len) {
+    static uint8_t encoded[AMYCHIP_COBS_ENCODED_MAX(8192)];
+    if (len > 8192) len = 8192;
+    sent_frames++;
+    host_uart_send_raw(encoded, amychip_cobs_encode(data, len, encoded));
+}
+
+static void host_uart_sender_task(void *pv_args) {
+    FILE *in = strcmp(host_config.uart_messages_path, "-") ? fopen(host_config.uart_messages_path, "r") : stdin;
+    if (in == NULL) {
+        ESP_LOGE(TAG, "can't open %s", host_config.uart_messages_path);
+        vTaskDelete(NULL);
+    }
+    int64_t start_us = esp_timer_get_time();
+    static char line[16384];
+    static uint8_t data[8192];
+    while (fgets(line, sizeof(line), in)) {
+        size_t len = strcspn(line, "\r\n");
+        line[len] = 0;
+        if (len == 0 || line[0] == '#') continue;
+        if (line[0] == '@') {
+            int64_t due_us = start_us + atoll(line + 1) * 1000LL;
+            int64_t now = esp_timer_get_time();
+            if (due_us > now) usleep((useconds_t)(due_us - now));
+            continue;
+        }
+        if (line[0] == '~') {
+            host_uart_send_raw(data, host_parse_hex(line + 1, data, sizeof(data)));
+            continue;
+        }
+        if (line[0] == '!') {
+            len = host_parse_hex(line + 1, data, sizeof(data));
+        } else {
+            if (len > sizeof(data)) len = sizeof(data);
+            memcpy(data, line, len);
+        }
+        host_uart_send_frame(data, len);
+    }
+    if (in != stdin) fclose(in);
+    uart_sender_handle = NULL;
+    vTaskDelete(NULL);
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size,
+                              QueueHandle_t *uart_queue, int intr_alloc_flags) {
+    uart_ring = malloc(rx_buffer_size);
+    uart_ring_size = rx_buffer_size;
+    uart_event_queue = xQueueCreate(queue_size, sizeof(uart_event_t));
+    if (uart_ring == NULL || uart_event_queue == NULL) return ESP_ERR_NO_MEM;
+    if (uart_queue) *uart_queue = uart_event_queue;
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t *uart_config) {
+    uart_baud = uart_config->baud_rate;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num) {
+    ESP_LOGI(TAG, "Initialising UART%d: %u baud, messages from %s", uart_num, uart_baud,
+             host_config.uart_messages_path ? host_config.uart_messages_path : "(none)");
+    if (host_config.uart_messages_path && uart_sender_handle == NULL) {
+        if (xTaskCreate(host_uart_sender_task, "uart_sender_task", 8192, NULL, 20, &uart_sender_handle) != pdPASS) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t uart_num, void *buf, uint32_t length, TickType_t ticks_to_wait) {
+    pthread_mutex_lock(&uart_lock);
+    size_t n = length < uart_ring_used ? length : uart_ring_used;
+    for (size_t i = 0; i < n; i++) {
+        ((uint8_t *)buf)[i] = uart_ring[(uart_ring_head + i) % uart_ring_size];
+    }
+    uart_ring_head = (uart_ring_head + n) % uart_ring_size;
+    uart_ring_used -= n;
+    pthread_mutex_unlock(&uart_lock);
+    return (int)n;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t *size) {
+    pthread_mutex_lock(&uart_lock);
+    *size = uart_ring_used;
+    pthread_mutex_unlock(&uart_lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t uart_num) {
+    pthread_mutex_lock(&uart_lock);
+    uart_ring_head = 0;
+    uart_ring_used = 0;
+    pthread_mutex_unlock(&uart_lock);
+    return ESP_OK;
+}
+
+void host_uart_report(FILE *f) {
+    fprintf(f, "uart sender: %u frames, %u bytes, %lld us on the wire, %u bytes lost to a full buffer\n",
+            sent_frames, sent_bytes, (long long)uart_wire_us, lost_bytes);
+}
@@ -0,0 +1,92 @@
+// host_wire_bench.c
+// Compares the ASCII AMY messages with the binary event frames in amychip_wire.c:
+// bytes on the bus and time to turn a message into an amy_event, over a mix of
+// chord note-ons and filter automation like a host would send.
+
+#include <string.h>
+#include "host_idf.h"
+#include "amy.h"
+#include "amychip_wire.h"
+#include "amychip_batch.h"
+
+#define BENCH_MAX_MESSAGE 64
+#define BENCH_SCL_HZ 400000
+#define BENCH_BATCH_WRITE 2048  // I2C_SLAVE_MAX_WRITE
+
+// One message of the mix in both formats
+static void host_wire_bench_message(int i, char *ascii, size_t *ascii_len, uint8_t *frame, size_t *frame_len) {
+    uint16_t osc = i % 64;
+    size_t n = amychip_wire_begin(frame, BENCH_MAX_MESSAGE, osc);
+    if (i % 2 == 0) {
+        uint8_t note = 48 + (i * 7) % 36;
+        float velocity = 0.25f + (i % 4) * 0.25f;
+        *ascii_len = snprintf(ascii, BENCH_MAX_MESSAGE, "v%uw1n%ul%g", osc, note, velocity);
+        n = amychip_wire_add(frame, n, BENCH_MAX_MESSAGE, AMYCHIP_FIELD_WAVE, 1);
+        n = amychip_wire_add(frame, n, BENCH_MAX_MESSAGE, AMYCHIP_FIELD_MIDI_NOTE, note);
+        n = amychip_wire_add(frame, n, BENCH_MAX_MESSAGE, AMYCHIP_FIELD_VELOCITY, velocity);
+    } else {
+        float cutoff = 200.0f + (i % 100) * 37.5f;
+        float resonance = 0.7f + (i % 8) * 0.5f;
+        *ascii_len = snprintf(ascii, BENCH_MAX_MESSAGE, "v%uF%gR%g", osc, cutoff, resonance);
+        n = amychip_wire_add(frame, n, BENCH_MAX_MESSAGE, AMYCHIP_FIELD_FILTER_FREQ, cutoff);
+        n = amychip_wire_add(frame, n, BENCH_MAX_MESSAGE, AMYCHIP_FIELD_RESONANCE, resonance);
+    }
+    *frame_len = n;
+}
+
+// One message per transaction: START, address, data, 9 clocks a byte, STOP
+static double host_wire_bench_bus_us(uint64_t bytes, uint64_t transactions) {
+    return ((bytes + transactions) * 9.0 + transactions * 2.0) * 1e6 / BENCH_SCL_HZ;
+}
+
+void host_wire_bench(FILE *f, int messages) {
+    char ascii[BENCH_MAX_MESSAGE];
+    uint8_t frame[BENCH_MAX_MESSAGE];
+    size_t ascii_len, frame_len;
+    uint64_t ascii_bytes = 0, frame_bytes = 0;
+    int64_t ascii_us = 0, frame_us = 0;
+    uint32_t errors = 0;
+    // Batched: records packed into writes of up to BENCH_BATCH_WRITE, split across writes where they fall
+    uint64_t batch_bytes = 0, batch_writes = 0, batch_fill = 0;
+    for (int i = 0; i < messages; i++) {
+        host_wire_bench_message(i, ascii, &ascii_len, frame, &frame_len);
+        ascii_bytes += ascii_len;
+        frame_bytes += frame_len;
+        uint8_t prefix[2];
+        size_t record = amychip_batch_prefix(prefix, frame_len) + frame_len;
+        while (record > 0) {
+            if (batch_fill == 0) {
+                batch_writes++;
+                batch_fill = 1;  // AMYCHIP_CMD_BATCH or _MORE
+                batch_bytes++;
+            }
+            size_t take = BENCH_BATCH_WRITE - batch_fill < record ? BENCH_BATCH_WRITE - batch_fill : record;
+            batch_fill += take;
+            batch_bytes += take;
+            record -= take;
+            if (batch_fill == BENCH_BATCH_WRITE) batch_fill = 0;
+        }
+        // amy_parse_message may write into the message, so each run gets a copy
+        char parse[BENCH_MAX_MESSAGE];
+        memcpy(parse, ascii, ascii_len + 1);
+        int64_t t = esp_timer_get_time();
+        amy_event a = amy_parse_message(parse);
+        ascii_us += esp_timer_get_time() - t;
+        t = esp_timer_get_time();
+        amy_event b;
+        bool ok = amychip_wire_decode(frame, frame_len, &b);
+        frame_us += esp_timer_get_time() - t;
+        if (!ok || a.osc != b.osc) errors++;
+    }
+    fprintf(f, "wire formats over %d messages (chord note-ons and filter automation):\n", messages);
+    fprintf(f, "  ascii:  %llu bytes (%.1f/message), %.1f ms on a 400 kHz bus, parse %.3f us/message\n",
+            (unsigned long long)ascii_bytes, (double)ascii_bytes / messages,
+            host_wire_bench_bus_us(ascii_bytes, messages) / 1000.0, (double)ascii_us / messages);
+    fprintf(f, "  binary: %llu bytes (%.1f/message), %.1f ms on a 400 kHz bus, decode %.3f us/message\n",
+            (unsigned long long)frame_bytes, (double)frame_bytes / messages,
+            host_wire_bench_bus_us(frame_bytes, messages) / 1000.0, (double)frame_us / messages);
+    fprintf(f, "  binary batched: %llu bytes in %llu writes, %.1f ms on a 400 kHz bus\n",
+            (unsigned long long)batch_bytes, (unsigned long long)batch_writes,
+            host_wire_bench_bus_us(batch_bytes, batch_writes) / 1000.0);
+    if (errors) fprintf(f, "  %u messages decoded differently\n", errors);
+}
@@ -0,0 +1,3 @@
+// Host build stand-in, see host_idf.h
+#pragma once
+#include "host_idf.h"
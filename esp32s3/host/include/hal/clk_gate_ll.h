@@ -0,0 +1,3 @@
+// Host build stand-in, see host_i2c_hw.h
+#pragma once
+#include "host_i2c_hw.h"
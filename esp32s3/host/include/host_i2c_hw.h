@@ -0,0 +1,134 @@
+// host_i2c_hw.h
+// A simulated ESP32-S3 I2C peripheral in slave mode, just enough of the
+// registers and hal/i2c_ll.h for ../main/esp32-hal-i2c-slave.c to run on the
+// host, and a master that clocks writes and reads into it at the bus rate
+// (host_i2c_hw.c). The 32 byte FIFOs, watermark interrupts and SCL stretching
+// behave like the S3's: the master waits, holding SCL, for a full RX FIFO, an
+// empty TX FIFO or the start of a read until the slave writes
+// slave_scl_stretch_clr. The interrupt handler runs on the master's thread.
+
+#ifndef __HOST_I2C_HW_H__
+#define __HOST_I2C_HW_H__
+
+#include "host_idf.h"
+#include "soc/soc_caps.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ---- soc/i2c_reg.h ----
+#define I2C_RXFIFO_WM_INT_ENA       (1 << 0)
+#define I2C_TXFIFO_WM_INT_ENA       (1 << 1)
+#define I2C_RXFIFO_OVF_INT_ENA      (1 << 2)
+#define I2C_END_DETECT_INT_ENA      (1 << 3)
+#define I2C_TRANS_COMPLETE_INT_ENA  (1 << 7)
+#define I2C_SLAVE_STRETCH_INT_ENA   (1 << 16)
+
+// ---- soc/i2c_struct.h ----
+typedef volatile struct i2c_dev_s {
+    union {
+        struct {
+            uint32_t slave_rw : 1;
+            uint32_t slave_addressed : 1;
+            uint32_t stretch_cause : 2;
+            uint32_t bus_busy : 1;
+        };
+        uint32_t val;
+    } sr;
+    union {
+        struct {
+            uint32_t stretch_protect_num : 10;
+            uint32_t slave_scl_stretch_en : 1;
+            uint32_t slave_scl_stretch_clr : 1;
+            uint32_t slave_byte_ack_ctl_en : 1;
+            uint32_t slave_byte_ack_lvl : 1;
+        };
+        uint32_t val;
+    } scl_stretch_conf;
+    union {
+        uint32_t val;
+    } int_ena;
+    union {
+        uint32_t val;
+    } int_raw;
+    uint32_t slave_addr;
+    uint32_t rxfifo_wm_thrhd;
+    uint32_t txfifo_wm_thrhd;
+} i2c_dev_t;
+extern i2c_dev_t I2C0;
+extern i2c_dev_t I2C1;
+
+// ---- hal/clk_gate_ll.h ----
+typedef enum { PERIPH_I2C0_MODULE, PERIPH_I2C1_MODULE } periph_module_t;
+static inline void periph_ll_enable_clk_clear_rst(periph_module_t periph) { }
+
+// ---- hal/i2c_ll.h, the IDF 5 names ----
+#define I2C_LL_INTR_MASK 0x3ffff
+#define I2C_LL_MAX_TIMEOUT 0x1f
+#define APB_CLK_FREQ 80000000
+typedef enum { SOC_MOD_CLK_APB = 1, SOC_MOD_CLK_XTAL = 2 } i2c_clock_source_sim_t;
+typedef struct {
+    uint16_t clkm_div;
+    uint16_t scl_low;
+    uint16_t scl_high;
+} i2c_hal_clk_config_t;
+
+static inline void i2c_ll_get_intr_mask(i2c_dev_t *hw, uint32_t *intr_status) {
+    *intr_status = __atomic_load_n(&hw->int_raw.val, __ATOMIC_ACQUIRE) & hw->int_ena.val;
+}
+static inline void i2c_ll_clear_intr_mask(i2c_dev_t *hw, uint32_t mask) {
+    __atomic_fetch_and(&hw->int_raw.val, ~mask, __ATOMIC_ACQ_REL);
+}
+static inline void i2c_ll_disable_intr_mask(i2c_dev_t *hw, uint32_t mask) { hw->int_ena.val &= ~mask; }
+static inline void i2c_ll_slave_enable_rx_it(i2c_dev_t *hw) {
+    hw->int_ena.val |= I2C_TRANS_COMPLETE_INT_ENA | I2C_RXFIFO_WM_INT_ENA;
+}
+static inline void i2c_ll_slave_enable_tx_it(i2c_dev_t *hw) { hw->int_ena.val |= I2C_TXFIFO_WM_INT_ENA; }
+static inline void i2c_ll_slave_disable_tx_it(i2c_dev_t *hw) { hw->int_ena.val &= ~I2C_TXFIFO_WM_INT_ENA; }
+static inline void i2c_ll_set_slave_addr(i2c_dev_t *hw, uint16_t slave_addr, bool addr_10bit_en) { hw->slave_addr = slave_addr; }
+static inline void i2c_ll_set_tout(i2c_dev_t *hw, int tout) { }
+static inline void i2c_ll_set_source_clk(i2c_dev_t *hw, int src_clk) { }
+static inline void i2c_ll_set_txfifo_empty_thr(i2c_dev_t *hw, uint8_t empty_thr) { hw->txfifo_wm_thrhd = empty_thr; }
+static inline void i2c_ll_set_rxfifo_full_thr(i2c_dev_t *hw, uint8_t full_thr) { hw->rxfifo_wm_thrhd = full_thr; }
+static inline bool i2c_ll_is_bus_busy(i2c_dev_t *hw) { return hw->sr.bus_busy; }
+static inline void i2c_ll_slave_init(i2c_dev_t *hw) { hw->int_ena.val = 0; hw->int_raw.val = 0; }
+static inline void i2c_ll_update(i2c_dev_t *hw) { }
+static inline void i2c_ll_master_set_filter(i2c_dev_t *hw, uint8_t filter_num) { }
+static inline void i2c_ll_slave_set_fifo_mode(i2c_dev_t *hw, bool fifo_mode_en) { }
+static inline void i2c_ll_master_cal_bus_clk(uint32_t source_clk, uint32_t bus_freq, i2c_hal_clk_config_t *clk_cal) {
+    clk_cal->clkm_div = 1;
+    clk_cal->scl_low = clk_cal->scl_high = source_clk / bus_freq / 2;
+}
+static inline void i2c_ll_master_set_bus_timing(i2c_dev_t *hw, i2c_hal_clk_config_t *bus_cfg) { }
+// The FIFOs, in host_i2c_hw.c
+void i2c_ll_get_rxfifo_cnt(i2c_dev_t *hw, uint32_t *length);
+void i2c_ll_get_txfifo_len(i2c_dev_t *hw, uint32_t *length);   // free space, as on the chip
+void i2c_ll_read_rxfifo(i2c_dev_t *hw, uint8_t *ptr, uint8_t len);
+void i2c_ll_write_txfifo(i2c_dev_t *hw, const uint8_t *ptr, uint8_t len);
+void i2c_ll_rxfifo_rst(i2c_dev_t *hw);
+void i2c_ll_txfifo_rst(i2c_dev_t *hw);
+
+// ---- the simulated master ----
+typedef struct {
+    uint32_t stretches[3];      // SCL held, by i2c_stretch_cause_t
+    uint32_t stretch_us_max;    // longest hold
+    uint32_t overflows;         // bytes written into a full RX FIFO
+    uint32_t underflows;        // bytes read from an empty TX FIFO
+    uint32_t timeouts;          // holds given up on after host_i2c_hw_set_timeout_us
+    uint32_t interrupts;        // handler calls
+    uint64_t interrupt_ns;      // time in the handler
+} host_i2c_hw_stats_t;
+void host_i2c_hw_set_hz(i2c_dev_t *hw, uint32_t hz);
+void host_i2c_hw_set_timeout_us(i2c_dev_t *hw, uint32_t us);
+// Returns the time the STOP went out, or -1 if a hold timed out
+int64_t host_i2c_hw_write(i2c_dev_t *hw, const uint8_t *data, size_t len);
+// A write then a repeated START and a read of len bytes, -1 on a timeout
+int64_t host_i2c_hw_write_read(i2c_dev_t *hw, const uint8_t *cmd, size_t cmd_len, uint8_t *data, size_t len);
+void host_i2c_hw_get_stats(i2c_dev_t *hw, host_i2c_hw_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __HOST_I2C_HW_H__
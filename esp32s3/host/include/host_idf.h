@@ -0,0 +1,391 @@
+// host_idf.h
+// Minimal stand-ins for the ESP-IDF and FreeRTOS APIs amychip uses, so the
+// firmware sources build and run on Linux. Tasks are pthreads, I2S and the
+// I2C buses are file/pipe backed (see host_i2s.c and host_i2c.c).
+
+#ifndef __HOST_IDF_H__
+#define __HOST_IDF_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ---- esp_err.h ----
+typedef int esp_err_t;
+#define ESP_OK                  0
+#define ESP_FAIL                -1
+#define ESP_ERR_NO_MEM          0x101
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_INVALID_STATE   0x103
+#define ESP_ERR_INVALID_SIZE    0x104
+#define ESP_ERR_NOT_FOUND       0x105
+#define ESP_ERR_NOT_SUPPORTED   0x106
+#define ESP_ERR_TIMEOUT         0x107
+#define ESP_ERROR_CHECK(x) do { esp_err_t __err = (x); if (__err != ESP_OK) { \
+    fprintf(stderr, "ESP_ERROR_CHECK failed: %d at %s:%d\n", __err, __FILE__, __LINE__); abort(); } } while (0)
+
+// ---- esp_timer.h ----
+int64_t esp_timer_get_time(void);
+
+// ---- esp_log.h ----
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E (%lld) %s: " fmt "\n", (long long)(esp_timer_get_time() / 1000), tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W (%lld) %s: " fmt "\n", (long long)(esp_timer_get_time() / 1000), tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) fprintf(stderr, "I (%lld) %s: " fmt "\n", (long long)(esp_timer_get_time() / 1000), tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) do { } while (0)
+
+// ---- FreeRTOS ----
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void *);
+typedef struct host_task *TaskHandle_t;
+typedef struct host_mutex *SemaphoreHandle_t;
+typedef struct host_queue *QueueHandle_t;
+
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  pdTRUE
+#define pdFAIL  pdFALSE
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms) * configTICK_RATE_HZ / 1000)
+#define configMAX_PRIORITIES 25
+#define ESP_TASK_PRIO_MAX configMAX_PRIORITIES
+#define tskIDLE_PRIORITY 0
+#define tskNO_AFFINITY 0x7fffffff
+#define portYIELD_FROM_ISR(...) do { } while (0)
+
+// ---- esp_attr.h ----
+#define IRAM_ATTR
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *param,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core_id);
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *param,
+                       UBaseType_t priority, TaskHandle_t *handle);
+void vTaskDelete(TaskHandle_t handle);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t handle);
+void vTaskNotifyGiveFromISR(TaskHandle_t handle, BaseType_t *higher_priority_task_woken);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait);
+BaseType_t xQueueReset(QueueHandle_t queue);
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item);
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_task_woken);
+BaseType_t xQueueIsQueueFullFromISR(QueueHandle_t queue);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+UBaseType_t uxQueueMessagesWaitingFromISR(QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue);
+#define xQueueSendToBack xQueueSend
+
+// Spinlocks: there are no interrupts on the host, so a critical section just spins
+typedef struct { volatile int locked; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define portMUX_INITIALIZE(mux) ((mux)->locked = 0)
+void vPortEnterCritical(portMUX_TYPE *mux);
+void vPortExitCritical(portMUX_TYPE *mux);
+#define portENTER_CRITICAL(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) vPortExitCritical(mux)
+#define portENTER_CRITICAL_SAFE(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_SAFE(mux) vPortExitCritical(mux)
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks_to_wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+
+// ---- freertos/ringbuf.h, byte buffers only ----
+typedef struct host_ringbuf *RingbufHandle_t;
+typedef enum { RINGBUF_TYPE_NOSPLIT = 0, RINGBUF_TYPE_ALLOWSPLIT, RINGBUF_TYPE_BYTEBUF } RingbufferType_t;
+RingbufHandle_t xRingbufferCreate(size_t size, RingbufferType_t type);
+void vRingbufferDelete(RingbufHandle_t ring);
+BaseType_t xRingbufferSendFromISR(RingbufHandle_t ring, const void *data, size_t size, BaseType_t *higher_priority_task_woken);
+void *xRingbufferReceiveUpTo(RingbufHandle_t ring, size_t *item_size, TickType_t ticks_to_wait, size_t max_size);
+void vRingbufferReturnItem(RingbufHandle_t ring, void *item);
+void vRingbufferGetInfo(RingbufHandle_t ring, UBaseType_t *free, UBaseType_t *read, UBaseType_t *write,
+                        UBaseType_t *acquire, UBaseType_t *items_waiting);
+
+// ---- esp_idf_version.h ----
+#define ESP_IDF_VERSION_VAL(major, minor, patch) (((major) << 16) | ((minor) << 8) | (patch))
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(5, 1, 0)
+
+// ---- esp_system.h / esp_chip_info.h / esp_flash.h ----
+#define CHIP_FEATURE_EMB_FLASH  (1 << 0)
+#define CHIP_FEATURE_WIFI_BGN   (1 << 1)
+#define CHIP_FEATURE_BLE        (1 << 4)
+#define CHIP_FEATURE_BT         (1 << 5)
+#define CHIP_FEATURE_IEEE802154 (1 << 6)
+typedef struct {
+    int model;
+    uint32_t features;
+    uint16_t revision;
+    uint8_t cores;
+} esp_chip_info_t;
+void esp_chip_info(esp_chip_info_t *out_info);
+typedef struct esp_flash_t esp_flash_t;
+esp_err_t esp_flash_get_size(esp_flash_t *chip, uint32_t *out_size);
+uint32_t esp_get_minimum_free_heap_size(void);
+
+// ---- esp_heap_caps.h ----
+#define MALLOC_CAP_DMA    (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+size_t heap_caps_get_free_size(uint32_t caps);
+#define heap_caps_malloc(size, caps) malloc(size)
+#define heap_caps_free(ptr) free(ptr)
+
+// ---- esp_rom_crc.h ----
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
+
+// ---- driver/i2c_master.h ----
+typedef enum { I2C_NUM_0 = 0, I2C_NUM_1 = 1 } i2c_port_num_t;
+typedef enum { I2C_CLK_SRC_DEFAULT = 0 } i2c_clock_source_t;
+typedef struct {
+    int i2c_port;
+    int sda_io_num;
+    int scl_io_num;
+    i2c_clock_source_t clk_source;
+    uint8_t glitch_ignore_cnt;
+    int intr_priority;
+    size_t trans_queue_depth;
+    struct {
+        uint32_t enable_internal_pullup : 1;
+    } flags;
+} i2c_master_bus_config_t;
+typedef struct {
+    int dev_addr_length;
+    uint16_t device_address;
+    uint32_t scl_speed_hz;
+    uint32_t scl_wait_us;
+} i2c_device_config_t;
+typedef struct host_i2c_bus *i2c_master_bus_handle_t;
+typedef struct host_i2c_dev *i2c_master_dev_handle_t;
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *bus_config, i2c_master_bus_handle_t *ret_bus_handle);
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t *dev_config, i2c_master_dev_handle_t *ret_handle);
+esp_err_t i2c_master_bus_rm_device(i2c_master_dev_handle_t handle);
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer, size_t write_size, int xfer_timeout_ms);
+
+// ---- driver/i2s_std.h ----
+typedef enum { I2S_NUM_0 = 0, I2S_NUM_AUTO = 2 } i2s_port_t;
+typedef enum { I2S_ROLE_MASTER = 0, I2S_ROLE_SLAVE = 1 } i2s_role_t;
+typedef enum { I2S_DATA_BIT_WIDTH_16BIT = 16, I2S_DATA_BIT_WIDTH_32BIT = 32 } i2s_data_bit_width_t;
+typedef enum { I2S_SLOT_MODE_MONO = 1, I2S_SLOT_MODE_STEREO = 2 } i2s_slot_mode_t;
+#define I2S_GPIO_UNUSED -1
+typedef struct {
+    i2s_port_t id;
+    i2s_role_t role;
+    uint32_t dma_desc_num;
+    uint32_t dma_frame_num;
+    bool auto_clear;
+    int intr_priority;
+} i2s_chan_config_t;
+#define I2S_CHANNEL_DEFAULT_CONFIG(i2s_num, i2s_role) { \
+    .id = i2s_num, \
+    .role = i2s_role, \
+    .dma_desc_num = 6, \
+    .dma_frame_num = 240, \
+    .auto_clear = false, \
+    .intr_priority = 0, \
+}
+typedef struct {
+    uint32_t sample_rate_hz;
+    int clk_src;
+    uint32_t mclk_multiple;
+} i2s_std_clk_config_t;
+#define I2S_STD_CLK_DEFAULT_CONFIG(rate) { .sample_rate_hz = rate, .clk_src = 0, .mclk_multiple = 256 }
+typedef struct {
+    i2s_data_bit_width_t data_bit_width;
+    i2s_slot_mode_t slot_mode;
+} i2s_std_slot_config_t;
+#define I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(bits, mode) { .data_bit_width = bits, .slot_mode = mode }
+typedef struct {
+    int mclk;
+    int bclk;
+    int ws;
+    int dout;
+    int din;
+    struct {
+        uint32_t mclk_inv : 1;
+        uint32_t bclk_inv : 1;
+        uint32_t ws_inv : 1;
+    } invert_flags;
+} i2s_std_gpio_config_t;
+typedef struct {
+    i2s_std_clk_config_t clk_cfg;
+    i2s_std_slot_config_t slot_cfg;
+    i2s_std_gpio_config_t gpio_cfg;
+} i2s_std_config_t;
+typedef struct host_i2s_chan *i2s_chan_handle_t;
+typedef struct {
+    void *data;
+    void *dma_buf;
+    size_t size;
+} i2s_event_data_t;
+typedef bool (*i2s_isr_callback_t)(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx);
+typedef struct {
+    i2s_isr_callback_t on_recv;
+    i2s_isr_callback_t on_recv_q_ovf;
+    i2s_isr_callback_t on_sent;
+    i2s_isr_callback_t on_send_q_ovf;
+} i2s_event_callbacks_t;
+esp_err_t i2s_channel_register_event_callback(i2s_chan_handle_t handle, const i2s_event_callbacks_t *callbacks, void *user_data);
+esp_err_t i2s_new_channel(const i2s_chan_config_t *chan_cfg, i2s_chan_handle_t *ret_tx_handle, i2s_chan_handle_t *ret_rx_handle);
+esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle, const i2s_std_config_t *std_cfg);
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle);
+esp_err_t i2s_del_channel(i2s_chan_handle_t handle);
+esp_err_t i2s_channel_read(i2s_chan_handle_t handle, void *dest, size_t size, size_t *bytes_read, uint32_t timeout_ms);
+esp_err_t i2s_channel_write(i2s_chan_handle_t handle, const void *src, size_t size, size_t *bytes_written, uint32_t timeout_ms);
+
+// ---- driver/spi_slave.h ----
+typedef enum { SPI1_HOST = 0, SPI2_HOST = 1, SPI3_HOST = 2 } spi_host_device_t;
+#define SPI_DMA_CH_AUTO 3
+typedef struct {
+    int mosi_io_num;
+    int miso_io_num;
+    int sclk_io_num;
+    int quadwp_io_num;
+    int quadhd_io_num;
+    int max_transfer_sz;
+    uint32_t flags;
+} spi_bus_config_t;
+typedef struct spi_slave_transaction_t spi_slave_transaction_t;
+typedef void (*slave_transaction_cb_t)(spi_slave_transaction_t *trans);
+typedef struct {
+    int spics_io_num;
+    uint32_t flags;
+    int queue_size;
+    uint8_t mode;
+    slave_transaction_cb_t post_setup_cb;
+    slave_transaction_cb_t post_trans_cb;
+} spi_slave_interface_config_t;
+struct spi_slave_transaction_t {
+    size_t length;      // bits
+    size_t trans_len;   // bits actually clocked
+    const void *tx_buffer;
+    void *rx_buffer;
+    void *user;
+};
+esp_err_t spi_slave_initialize(spi_host_device_t host, const spi_bus_config_t *bus_config,
+                               const spi_slave_interface_config_t *slave_config, int dma_chan);
+esp_err_t spi_slave_queue_trans(spi_host_device_t host, const spi_slave_transaction_t *trans_desc, TickType_t ticks_to_wait);
+esp_err_t spi_slave_get_trans_result(spi_host_device_t host, spi_slave_transaction_t **trans_desc, TickType_t ticks_to_wait);
+
+// ---- driver/uart.h ----
+typedef int uart_port_t;
+#define UART_NUM_0 0
+#define UART_NUM_1 1
+#define UART_PIN_NO_CHANGE (-1)
+typedef enum { UART_DATA_5_BITS, UART_DATA_6_BITS, UART_DATA_7_BITS, UART_DATA_8_BITS } uart_word_length_t;
+typedef enum { UART_PARITY_DISABLE = 0, UART_PARITY_EVEN = 2, UART_PARITY_ODD = 3 } uart_parity_t;
+typedef enum { UART_STOP_BITS_1 = 1, UART_STOP_BITS_1_5 = 2, UART_STOP_BITS_2 = 3 } uart_stop_bits_t;
+typedef enum { UART_HW_FLOWCTRL_DISABLE = 0 } uart_hw_flowcontrol_t;
+typedef enum { UART_SCLK_DEFAULT = 0 } uart_sclk_t;
+typedef struct {
+    int baud_rate;
+    uart_word_length_t data_bits;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uint8_t rx_flow_ctrl_thresh;
+    uart_sclk_t source_clk;
+} uart_config_t;
+typedef enum {
+    UART_DATA, UART_BREAK, UART_BUFFER_FULL, UART_FIFO_OVF, UART_FRAME_ERR,
+    UART_PARITY_ERR, UART_DATA_BREAK, UART_PATTERN_DET, UART_EVENT_MAX
+} uart_event_type_t;
+typedef struct {
+    uart_event_type_t type;
+    size_t size;
+    bool timeout_flag;
+} uart_event_t;
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size,
+                              QueueHandle_t *uart_queue, int intr_alloc_flags);
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t *uart_config);
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num);
+int uart_read_bytes(uart_port_t uart_num, void *buf, uint32_t length, TickType_t ticks_to_wait);
+esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t *size);
+esp_err_t uart_flush_input(uart_port_t uart_num);
+
+// ---- esp_intr_alloc.h ----
+typedef struct host_intr *intr_handle_t;
+typedef void (*intr_handler_t)(void *arg);
+#define ESP_INTR_FLAG_LOWMED (1 << 1 | 1 << 2 | 1 << 3)
+#define ESP_INTR_FLAG_SHARED (1 << 8)
+#define ETS_I2C_EXT0_INTR_SOURCE 42
+#define ETS_I2C_EXT1_INTR_SOURCE 43
+esp_err_t esp_intr_alloc(int source, int flags, intr_handler_t handler, void *arg, intr_handle_t *ret_handle);
+esp_err_t esp_intr_free(intr_handle_t handle);
+
+// ---- driver/gpio.h, rom/gpio.h, soc/gpio_sig_map.h ----
+typedef enum {
+    GPIO_MODE_DISABLE = 0,
+    GPIO_MODE_INPUT = 1 << 0,
+    GPIO_MODE_OUTPUT = 1 << 1,
+    GPIO_MODE_DEF_OD = 1 << 2,
+    GPIO_MODE_OUTPUT_OD = (1 << 1) | (1 << 2),
+    GPIO_MODE_INPUT_OUTPUT_OD = (1 << 0) | (1 << 1) | (1 << 2),
+    GPIO_MODE_INPUT_OUTPUT = (1 << 0) | (1 << 1),
+} gpio_mode_t;
+typedef enum { GPIO_PULLUP_DISABLE = 0, GPIO_PULLUP_ENABLE = 1 } gpio_pullup_t;
+typedef enum { GPIO_PULLDOWN_DISABLE = 0, GPIO_PULLDOWN_ENABLE = 1 } gpio_pulldown_t;
+typedef enum { GPIO_INTR_DISABLE = 0 } gpio_int_type_t;
+typedef struct {
+    uint64_t pin_bit_mask;
+    gpio_mode_t mode;
+    gpio_pullup_t pull_up_en;
+    gpio_pulldown_t pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+esp_err_t gpio_config(const gpio_config_t *config);
+esp_err_t gpio_set_level(int gpio_num, uint32_t level);
+int gpio_get_level(int gpio_num);  // the simulated bus always idles high
+void gpio_matrix_out(uint32_t gpio, uint32_t signal_idx, bool out_inv, bool oen_inv);
+void gpio_matrix_in(uint32_t gpio, uint32_t signal_idx, bool inv);
+#define I2CEXT0_SCL_OUT_IDX 89
+#define I2CEXT0_SDA_OUT_IDX 90
+#define I2CEXT1_SCL_OUT_IDX 91
+#define I2CEXT1_SDA_OUT_IDX 92
+
+// ---- host side controls (host_main.c, host_i2s.c, host_i2c.c) ----
+typedef struct {
+    const char *audio_in_path;    // raw s16le interleaved, NULL = silence
+    const char *audio_out_path;   // raw s16le interleaved, NULL = discard
+    const char *messages_path;    // one I2C write per line, file or fifo, "-" = stdin
+    const char *codec_log_path;   // WM8960 register writes, NULL = discard
+    const char *block_log_path;   // per-block render time CSV, NULL = none
+    int free_run;                 // 1 = don't pace I2S to the sample clock
+    const char *spi_messages_path; // one SPI transaction per line, like messages_path
+    uint32_t spi_hz;              // the simulated SPI master's clock
+    const char *uart_messages_path; // one COBS frame per line, like messages_path
+} host_config_t;
+extern host_config_t host_config;
+void host_i2s_report(FILE *f);
+void host_i2c_report(FILE *f);
+void host_irq_report(FILE *f);
+void host_spi_report(FILE *f);
+void host_uart_report(FILE *f);
+
+// The simulated masters: one write or transaction, paced like the wire
+void host_i2c_master_write(const uint8_t *data, size_t len);
+size_t host_i2c_master_read(const uint8_t *data, size_t len, uint8_t *out, size_t n);
+void host_spi_master_transfer(const uint8_t *data, size_t len);
+void host_uart_send_frame(const uint8_t *data, size_t len);
+int64_t host_uart_wire_us(size_t bytes);
+int64_t host_i2c_receive_us(void);  // time spent in the I2C receive callback
+size_t host_parse_hex(const char *hex, uint8_t *out, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,5 @@
+// Host build stand-in, see host_idf.h
+#pragma once
+#include "host_idf.h"
+#define CONFIG_IDF_TARGET "linux"
+#define CONFIG_FREERTOS_HZ configTICK_RATE_HZ
@@ -0,0 +1,6 @@
+// Host build stand-in, see host_idf.h
+#pragma once
+#include "host_idf.h"
+#define SOC_I2C_NUM 2
+#define SOC_I2C_FIFO_LEN 32
+#define SOC_I2C_SUPPORT_APB 1
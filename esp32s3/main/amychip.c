@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include <inttypes.h>
 #include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
@@ -9,13 +10,28 @@
 #include "esp_task.h"
 #include "driver/i2c_master.h"
 #include "wm8960.h"
+#include "amychip_codec.h"
 
 #include "amy.h"
 #include "examples.h"
 #include "freertos/queue.h"
 #include "freertos/event_groups.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "amychip.h"
+#include "amychip_protocol.h"
+#include "amychip_ring.h"
+#include "amychip_wire.h"
+#include "amychip_batch.h"
+#include "amychip_regs.h"
+#include "amychip_irq.h"
+#include "amychip_spi.h"
+#include "amychip_uart.h"
+#include "amychip_sched.h"
+#include "amychip_upload.h"
 
 #include "driver/i2s_std.h"
 
@@ -33,6 +49,13 @@ i2s_chan_handle_t rx_handle;
 #define I2C_MASTER_SCL 17
 #define I2C_MASTER_SDA 18
 #define I2S_DOUT 16 // data coming from the codec, eg ADC  data
+#define IRQ_GPIO 6 // open drain interrupt line to the host, low while events are waiting
+#define SPI_SLAVE_MOSI 8
+#define SPI_SLAVE_MISO 9
+#define SPI_SLAVE_SCLK 14
+#define SPI_SLAVE_CS 10
+#define UART_CTRL_TX 1
+#define UART_CTRL_RX 2
 #define I2S_SAMPLE_TYPE I2S_BITS_PER_SAMPLE_16BIT
 typedef int16_t i2s_sample_type;
 
@@ -47,6 +70,7 @@ void delay_ms(uint32_t ms) {
 // Task handles for the renderers, multicast listener and main
 TaskHandle_t amy_render_handle;
 TaskHandle_t alles_fill_buffer_handle;
+TaskHandle_t i2s_write_handle;
 
 
 #define ALLES_TASK_COREID (1)
@@ -60,35 +84,119 @@ TaskHandle_t alles_fill_buffer_handle;
 #define ALLES_TASK_STACK_SIZE    (8 * 1024) 
 #define ALLES_RENDER_TASK_STACK_SIZE (8 * 1024)
 #define ALLES_FILL_BUFFER_TASK_STACK_SIZE (8 * 1024)
+#define I2S_WRITE_TASK_COREID (0)
+#define I2S_WRITE_TASK_PRIORITY (ESP_TASK_PRIO_MAX-1)
+#define I2S_WRITE_TASK_NAME "i2s_w_task"
+#define I2S_WRITE_TASK_STACK_SIZE (4 * 1024)
+
+#define I2S_BLOCK_BYTES (AMY_BLOCK_SIZE * AMY_BYTES_PER_SAMPLE * AMY_NCHANS)
+
+// Pipelined output: the fill task hands each finished block to esp_i2s_write_task
+// through up to AUDIO_PIPELINE_DEPTH block buffers, so block N+1 renders while block N
+// waits for room in the I2S DMA. Set to 0 to write from the fill task in sequence.
+// How many of them are in use is the render-ahead depth, RENDER_AHEAD_AT_BOOT and
+// then AMYCHIP_CMD_RENDER_AHEAD. The queue of finished blocks is headroom for the
+// odd long block (a patch load, a burst of notes): the writer keeps the DAC fed
+// from it while the renderer catches up. It refills by itself, the renderer runs
+// ahead whenever it has a free buffer and input (if any) waiting.
+// Every buffer of depth adds a transfer of output latency.
+#ifndef AUDIO_PIPELINE_DEPTH
+#define AUDIO_PIPELINE_DEPTH 4
+#endif
+#ifndef RENDER_AHEAD_AT_BOOT
+#define RENDER_AHEAD_AT_BOOT 2
+#endif
+
+// Direct DMA output: each DMA descriptor holds exactly one AMY block, and the fill
+// task copies the finished block straight into the descriptor buffer the driver
+// just finished sending (the on_sent callback), with no i2s_channel_write, no driver
+// queue and no pipeline copy. The DMA ring is the pipeline, so this overrides
+// AUDIO_PIPELINE_DEPTH; the latency profile's dma_desc_num blocks of output latency.
+#ifndef AUDIO_DIRECT_DMA
+#define AUDIO_DIRECT_DMA 0
+#endif
+
+#if AUDIO_DIRECT_DMA
+#undef AUDIO_PIPELINE_DEPTH
+#define AUDIO_PIPELINE_DEPTH 0
+#endif
+
+// Latency profiles trade output latency for headroom. Each sets how many AMY blocks
+// are rendered per I2S transfer and how the I2S DMA ring is laid out, and can be
+// changed at runtime with AMYCHIP_CMD_LATENCY_PROFILE. In direct DMA mode a
+// descriptor is always one AMY block, so only dma_desc_num applies.
+typedef struct {
+    const char *name;
+    uint8_t blocks_per_write;
+    uint16_t dma_desc_num;
+    uint16_t dma_frame_num;
+} latency_profile_t;
+
+#define MAX_BLOCKS_PER_WRITE 4
+#define MAX_DMA_DESC_NUM 8
+static const latency_profile_t latency_profiles[AMYCHIP_LATENCY_PROFILES] = {
+    [AMYCHIP_LATENCY_LOW]        = { "low",        1, 2, AMY_BLOCK_SIZE },
+    [AMYCHIP_LATENCY_DEFAULT]    = { "default",    1, 6, 240 },
+    [AMYCHIP_LATENCY_THROUGHPUT] = { "throughput", MAX_BLOCKS_PER_WRITE, MAX_DMA_DESC_NUM, 512 },
+};
+#ifndef LATENCY_PROFILE_AT_BOOT
+#define LATENCY_PROFILE_AT_BOOT AMYCHIP_LATENCY_DEFAULT
+#endif
+static uint8_t latency_profile = LATENCY_PROFILE_AT_BOOT;
+static volatile uint8_t latency_profile_pending = LATENCY_PROFILE_AT_BOOT;
+
+// The rate I2S and the codec run at. AMY still renders for AMY_SAMPLE_RATE, so
+// any other rate shifts pitch and tempo by sample_rate / AMY_SAMPLE_RATE.
+static volatile uint32_t sample_rate = AMY_SAMPLE_RATE;
+static volatile uint32_t sample_rate_pending = AMY_SAMPLE_RATE;
+// A change the codec worker has, 0 if none, and how the codec took it
+static uint32_t sample_rate_ticket = 0;
+static uint32_t sample_rate_changing = 0;
+static esp_err_t sample_rate_result = ESP_OK;
 
 
 // i2c stuff
 #define I2C_CLK_FREQ 400000
 #include "esp32-hal-i2c-slave.h"
-#define DATA_LENGTH 255
+// The longest single write from the host, batches included. Longer batches carry on
+// in the next write with AMYCHIP_CMD_BATCH_MORE.
+#define I2C_SLAVE_MAX_WRITE 2048
 #define _I2C_NUMBER(num) I2C_NUM_##num
 #define I2C_NUMBER(num) _I2C_NUMBER(num)
 #define I2C_SLAVE_NUM I2C_NUMBER(1) /*!< I2C port number for slave dev */
-#define I2C_SLAVE_TX_BUF_LEN (2 * DATA_LENGTH)              /*!< I2C slave tx buffer size */
-#define I2C_SLAVE_RX_BUF_LEN (2 * DATA_LENGTH)              /*!< I2C slave rx buffer size */
+#define I2C_SLAVE_TX_BUF_LEN 4096              /*!< I2C slave tx ring size, a read can return up to this */
+#define I2C_SLAVE_RX_BUF_LEN I2C_SLAVE_MAX_WRITE              /*!< I2C slave rx buffer size */
 #define ESP_SLAVE_ADDR 0x58             /*!< ESP32 slave address, you can set any 7bit value */
+// Take messages over SPI as well as I2C. Off unless asked for, it takes GPIO 8, 9, 10 and 14.
+#ifndef SPI_SLAVE_ENABLED
+#define SPI_SLAVE_ENABLED 0
+#endif
+
+// And over a UART, COBS framed. Off unless asked for, it takes GPIO 1 and 2.
+#ifndef UART_CTRL_ENABLED
+#define UART_CTRL_ENABLED 0
+#endif
+#define UART_CTRL_NUM 1
+#define UART_CTRL_BAUD 3000000
+
+// What drives the interrupt line, an amychip_irq_line_t
+#ifndef AMYCHIP_IRQ_LINE
+#define AMYCHIP_IRQ_LINE amychip_irq_gpio
+#endif
+extern const amychip_irq_line_t AMYCHIP_IRQ_LINE;
 #define I2C_MASTER_NUM I2C_NUMBER(0) /*!< I2C port number for master dev */
 #define I2C_MASTER_TX_BUF_DISABLE 0                           /*!< I2C master doesn't need buffer */
 #define I2C_MASTER_RX_BUF_DISABLE 0  
 
+// DMA frames the I2S TX channel buffers, set in setup_i2s
+uint32_t i2s_dma_frames = 0;
+
 i2c_master_bus_handle_t tool_bus_handle;
+// The codec, added to the bus once in i2c_master_init
+static i2c_master_dev_handle_t wm8960_handle;
 #define I2C_TOOL_TIMEOUT_VALUE_MS (50)
 esp_err_t i2c_master_write_wm8960(uint8_t *data_wr, size_t size_wr) {
-
-    i2c_device_config_t i2c_dev_conf = {
-        .scl_speed_hz = I2C_CLK_FREQ,
-        .device_address = 0x1A,
-    };
-    i2c_master_dev_handle_t dev_handle;
-    if (i2c_master_bus_add_device(tool_bus_handle, &i2c_dev_conf, &dev_handle) != ESP_OK) {
-        return 1;
-    }
-    esp_err_t ret = i2c_master_transmit(dev_handle, data_wr, size_wr, I2C_TOOL_TIMEOUT_VALUE_MS);
+    esp_err_t ret = i2c_master_transmit(wm8960_handle, data_wr, size_wr, I2C_TOOL_TIMEOUT_VALUE_MS);
     if (ret == ESP_OK) {
         //ESP_LOGI(TAG, "Write OK");
     } else if (ret == ESP_ERR_TIMEOUT) {
@@ -96,13 +204,45 @@ esp_err_t i2c_master_write_wm8960(uint8_t *data_wr, size_t size_wr) {
     } else {
         ESP_LOGW(TAG, "Write Failed");
     }
-    if (i2c_master_bus_rm_device(dev_handle) != ESP_OK) {
-        return 1;
+    return ret;
+}
+
+// count 2 byte register writes, one transaction each (the WM8960 doesn't
+// auto-increment), back to back. Stops at the first that fails.
+esp_err_t i2c_master_write_wm8960_batch(uint8_t *writes, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        esp_err_t ret = i2c_master_write_wm8960(writes + 2 * i, 2);
+        if (ret != ESP_OK) return ret;
     }
-    return 0;
+    return ESP_OK;
+}
 
+
+// The DAC's driver, an amychip_codec_driver_t
+#ifndef AMYCHIP_CODEC
+#define AMYCHIP_CODEC amychip_codec_wm8960
+#endif
+
+static uint32_t codec_init_us = 0;
+
+uint32_t esp_get_codec_init_us() {
+    return codec_init_us;
 }
 
+// After init the codec belongs to the worker, so no caller waits on the bus.
+// The transports start first; controls before the worker is up are dropped.
+#define CODEC_TASK_PRIORITY (tskIDLE_PRIORITY + 2)
+static esp_err_t codec_init(void) {
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = AMYCHIP_CODEC.init(sample_rate);
+    codec_init_us = (uint32_t)(esp_timer_get_time() - start);
+    if(ret != ESP_OK) return ret;
+    ESP_LOGI(TAG, "%s init took %" PRIu32 " us", AMYCHIP_CODEC.name, codec_init_us);
+    ret = amychip_codec_init(AMYCHIP_CODEC.write_register, CODEC_TASK_PRIORITY);
+    if(ret != ESP_OK) return ret;
+    if(AMYCHIP_CODEC.queue_writes != NULL) AMYCHIP_CODEC.queue_writes(&amychip_codec_write);
+    return ESP_OK;
+}
 
 static esp_err_t i2c_master_init(void) {
     i2c_master_bus_config_t i2c_bus_config = {
@@ -117,85 +257,1124 @@ static esp_err_t i2c_master_init(void) {
     if (i2c_new_master_bus(&i2c_bus_config, &tool_bus_handle) != ESP_OK) {
         return 1;
     }
+    i2c_device_config_t i2c_dev_conf = {
+        .scl_speed_hz = I2C_CLK_FREQ,
+        .device_address = 0x1A,
+    };
+    if (i2c_master_bus_add_device(tool_bus_handle, &i2c_dev_conf, &wm8960_handle) != ESP_OK) {
+        return 1;
+    }
     return ESP_OK;
 }
 
 
 
+// Where the next status register read starts, set by AMYCHIP_CMD_REGISTER
+static volatile uint8_t register_pointer = 0;
+
+static void esp_send_registers(uint8_t reg) {
+    uint8_t data[AMYCHIP_REGS_SIZE];
+    size_t len = amychip_regs_read(reg, data, sizeof(data));
+    if(len > 0) i2cSlaveWrite(I2C_SLAVE_NUM, data, len, 0);
+}
+
+// [count, events...], at most max events
+static void esp_send_events(uint8_t max) {
+    uint8_t data[1 + AMYCHIP_IRQ_FIFO_LEN * AMYCHIP_EVENT_BYTES];
+    if(max > AMYCHIP_IRQ_FIFO_LEN) max = AMYCHIP_IRQ_FIFO_LEN;
+    data[0] = (uint8_t)amychip_irq_pop(data + 1, max);
+    i2cSlaveWrite(I2C_SLAVE_NUM, data, 1 + data[0] * AMYCHIP_EVENT_BYTES, 0);
+}
+
+static void put_u32_le(uint8_t *out, uint32_t value) {
+    for(int i = 0; i < 4; i++) out[i] = (value >> (8 * i)) & 0xff;
+}
+
+static uint32_t get_u32_le(const uint8_t *in) {
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+// [host time, sample clock, sample rate] for AMYCHIP_CMD_CLOCK
+static void esp_send_clock(const uint8_t *cmd, size_t len) {
+    uint8_t data[12];
+    uint32_t clock = esp_get_sample_clock();
+    put_u32_le(data, len >= 5 ? get_u32_le(cmd + 1) : 0);
+    put_u32_le(data + 4, clock);
+    put_u32_le(data + 8, sample_rate);
+    i2cSlaveWrite(I2C_SLAVE_NUM, data, sizeof(data), 0);
+}
+
+// Sample uploads go straight from the transport tasks into PSRAM, one at a time.
+// The sample itself is allocated by the fill task between blocks, like any other
+// change to AMY; upload_started hands the transport the upload's state after that.
+// The transports hold upload_lock for a whole chunk, so the fill task only ever
+// tries for it and has another go at the next block.
+#define UPLOAD_START_TIMEOUT_MS 250
+#define UPLOAD_BEGIN_LEN 20
+static amychip_upload_t upload;
+static SemaphoreHandle_t upload_lock;
+static QueueHandle_t upload_started;
+static uint8_t upload_begin_waiting[UPLOAD_BEGIN_LEN];  // fill task only
+static bool upload_begin_pending = false;
+
+// The fill task's half of AMYCHIP_CMD_UPLOAD, between blocks
+static void esp_upload_try_begin() {
+    if(xSemaphoreTake(upload_lock, 0) != pdTRUE) return;
+    const uint8_t *data = upload_begin_waiting;
+    uint16_t patch = data[1] | (data[2] << 8);
+    uint32_t samples = get_u32_le(data + 3);
+    upload_begin_pending = false;
+    // pcm_load may free the buffer an upload in flight is copying into
+    amychip_upload_init(&upload);
+    int16_t *buf = pcm_load(patch, samples, get_u32_le(data + 7), data[11], get_u32_le(data + 12), get_u32_le(data + 16));
+    if(buf == NULL) {
+        ESP_LOGW(TAG, "no room to upload %" PRIu32 " samples to patch %d", samples, patch);
+        amychip_upload_fail(&upload, patch);
+    } else {
+        amychip_upload_start(&upload, patch, (uint8_t *)buf, samples * 2);
+    }
+    uint8_t state = upload.state;
+    xSemaphoreGive(upload_lock);
+    xQueueOverwrite(upload_started, &state);
+}
+
+// Played from the message queue; a newer upload replaces one still waiting
+static void esp_upload_begin(const uint8_t *data, size_t len) {
+    if(len < UPLOAD_BEGIN_LEN) return;
+    memcpy(upload_begin_waiting, data, UPLOAD_BEGIN_LEN);
+    upload_begin_pending = true;
+    esp_upload_try_begin();
+}
+
+static void esp_upload_chunk(const uint8_t *data, size_t len) {
+    if(len < 9) return;
+    xSemaphoreTake(upload_lock, portMAX_DELAY);
+    int result = amychip_upload_chunk(&upload, get_u32_le(data + 1), get_u32_le(data + 5), data + 9, len - 9);
+    uint16_t patch = upload.patch;
+    xSemaphoreGive(upload_lock);
+    if(result == AMYCHIP_UPLOAD_CHUNK_DONE) amychip_irq_post(AMYCHIP_EVENT_UPLOAD_DONE, patch);
+}
+
+// [credits, drops] for AMYCHIP_CMD_CREDITS. Drops count every message lost
+// after it was sent: to a full queue, or refused by a full schedule.
+static void esp_send_credits() {
+    uint8_t data[8];
+    amychip_ring_info_t ring;
+    esp_get_command_ring(&ring);
+    put_u32_le(data, esp_get_credits());
+    put_u32_le(data + 4, ring.drops + amychip_stats.sched_drops);
+    i2cSlaveWrite(I2C_SLAVE_NUM, data, sizeof(data), 0);
+}
+
+// [result, sample rate] for AMYCHIP_CMD_SAMPLE_RATE as a write-then-read
+static void esp_send_sample_rate_result(const uint8_t *cmd, size_t len) {
+    uint8_t data[8];
+    esp_err_t ret = len >= 5 ? esp_set_sample_rate(get_u32_le(cmd + 1)) : ESP_ERR_INVALID_ARG;
+    put_u32_le(data, (uint32_t)ret);
+    put_u32_le(data + 4, sample_rate);
+    i2cSlaveWrite(I2C_SLAVE_NUM, data, sizeof(data), 0);
+}
+
+// [state, patch, received, expected, refused] for AMYCHIP_CMD_UPLOAD_STATUS
+static void esp_send_upload_status() {
+    uint8_t data[15];
+    xSemaphoreTake(upload_lock, portMAX_DELAY);
+    data[0] = upload.state;
+    data[1] = upload.patch & 0xff;
+    data[2] = upload.patch >> 8;
+    put_u32_le(data + 3, upload.received);
+    put_u32_le(data + 7, upload.size);
+    put_u32_le(data + 11, upload.bad_crc + upload.bad_offset);
+    xSemaphoreGive(upload_lock);
+    i2cSlaveWrite(I2C_SLAVE_NUM, data, sizeof(data), 0);
+}
+
+void esp_get_upload(amychip_upload_t *out) {
+    xSemaphoreTake(upload_lock, portMAX_DELAY);
+    *out = upload;
+    xSemaphoreGive(upload_lock);
+}
+
 static void i2c_slave_request_cb(uint8_t num, uint8_t *cmd, uint8_t cmd_len, void * arg) {
-    if (cmd_len > 0) {
+    if (cmd_len > 0 && cmd[0] == AMYCHIP_CMD_CLOCK) {
+        esp_send_clock(cmd, cmd_len);
+    } else if (cmd_len > 0 && cmd[0] == AMYCHIP_CMD_CREDITS) {
+        esp_send_credits();
+    } else if (cmd_len > 0 && cmd[0] == AMYCHIP_CMD_UPLOAD_STATUS) {
+        esp_send_upload_status();
+    } else if (cmd_len > 0 && cmd[0] == AMYCHIP_CMD_SAMPLE_RATE) {
+        esp_send_sample_rate_result(cmd, cmd_len);
+    } else if (cmd_len > 0 && cmd[0] == AMYCHIP_CMD_EVENTS) {
+        esp_send_events(cmd_len >= 2 ? cmd[1] : 1);
+    } else if (cmd_len > 0 && cmd[0] == AMYCHIP_CMD_REGISTER) {
+        // write-then-read of the status registers: the whole rest of the map goes out at once
+        if(cmd_len >= 2) register_pointer = cmd[1];
+        esp_send_registers(register_pointer);
+    } else if (cmd_len > 0) {
         // first write to master
         i2cSlaveWrite(I2C_SLAVE_NUM, cmd, cmd_len, 0);
+    } else if (cmd != NULL) {
+        // a read with no write before it
+        esp_send_registers(register_pointer);
     } else {
-        // cmd_len == 0 means master want more data from slave
+        // cmd == NULL means master want more data from slave
         // we just send one byte 0 each time to master here
         uint8_t extra_data = 0x00;
         i2cSlaveWrite(I2C_SLAVE_NUM, &extra_data, 1, 0);
     }
 }
 
+// On the codec worker, arg is the control and its value
+static void codec_control_job(uint32_t arg) {
+    uint8_t control = (uint8_t)(arg >> 8);
+    int8_t value = (int8_t)(arg & 0xff);
+    esp_err_t ret;
+    switch(control) {
+        case AMYCHIP_CODEC_VOLUME_DB:
+            ret = AMYCHIP_CODEC.set_volume_db(value);
+            break;
+        case AMYCHIP_CODEC_MUTE:
+            ret = AMYCHIP_CODEC.set_mute(value != 0);
+            break;
+        case AMYCHIP_CODEC_POWER:
+            ret = AMYCHIP_CODEC.set_power(value != 0);
+            break;
+        default:
+            ret = AMYCHIP_CODEC.control ? AMYCHIP_CODEC.control(control, value) : ESP_ERR_NOT_SUPPORTED;
+            break;
+    }
+    if(ret != ESP_OK) ESP_LOGW(TAG, "%s can't do codec control %d", AMYCHIP_CODEC.name, control);
+}
+
+// Runtime codec changes, AMYCHIP_CODEC_*. Only handed to the worker here, see amychip_codec.h
+static void esp_set_codec(uint8_t control, int8_t value) {
+    if(!amychip_codec_run(&codec_control_job, control, (uint32_t)control << 8 | (uint8_t)value)) {
+        ESP_LOGW(TAG, "codec control %d dropped, the codec worker is down or busy", control);
+    }
+}
+
+// Commands for the chip itself rather than AMY, see amychip_protocol.h
+static void esp_chip_command(uint8_t * data, size_t len) {
+    switch(data[0]) {
+        case AMYCHIP_CMD_LATENCY_PROFILE:
+            if(len >= 2) esp_set_latency_profile(data[1]);
+            break;
+        case AMYCHIP_CMD_SHED_POLICY:
+            if(len >= 2) esp_set_shed_policy(data[1]);
+            break;
+        case AMYCHIP_CMD_RENDER_AHEAD:
+            if(len >= 2) esp_set_render_ahead(data[1]);
+            break;
+        case AMYCHIP_CMD_REGISTER:
+            if(len >= 2) register_pointer = data[1];
+            break;
+        case AMYCHIP_CMD_UPLOAD:
+            // only reaches here from the message queue, see esp_upload_request
+            esp_upload_begin(data, len);
+            break;
+        case AMYCHIP_CMD_UPLOAD_CHUNK:
+            esp_upload_chunk(data, len);
+            break;
+        case AMYCHIP_CMD_EVENTS:
+        case AMYCHIP_CMD_CLOCK:
+        case AMYCHIP_CMD_UPLOAD_STATUS:
+        case AMYCHIP_CMD_CREDITS:
+            // only mean something as the write half of a read
+            break;
+        case AMYCHIP_CMD_TICK:
+            if(len >= 3) esp_set_tick_interval(data[1] | (data[2] << 8));
+            break;
+        case AMYCHIP_CMD_CODEC:
+            if(len >= 3) esp_set_codec(data[1], (int8_t)data[2]);
+            break;
+        case AMYCHIP_CMD_SAMPLE_RATE:
+            if(len >= 5) esp_set_sample_rate(get_u32_le(data + 1));
+            break;
+        default:
+            ESP_LOGW(TAG, "unknown command 0x%02x", data[0]);
+            break;
+    }
+}
+
+// AMY messages are queued here by the I2C slave task and played by the fill task
+// at the start of the next block, so parsing never lands mid-render and the audio
+// tasks never wait on the I2C side.
+#define COMMAND_RING_BYTES 8192 // power of two, room for two full SPI transactions
+#define COMMAND_MESSAGE_MAX 512
+static uint8_t command_ring_buf[COMMAND_RING_BYTES];
+static amychip_ring_t command_ring;
+
+// The ring takes one producer at a time, the transports take turns
+static SemaphoreHandle_t command_ring_lock;
+
+static amychip_batch_t i2c_batch;
+static amychip_batch_t spi_batch;
+static amychip_batch_t uart_batch;
+
+// AMYCHIP_EVENT_QUEUE_HIGH goes out once as the ring fills past 3/4 and again
+// only after the fill task has brought it back under 1/4
+#define COMMAND_RING_HIGH (COMMAND_RING_BYTES * 3 / 4)
+#define COMMAND_RING_LOW (COMMAND_RING_BYTES / 4)
+static volatile uint8_t command_ring_high = 0;
+
+// Queue a message for the fill task to play at the next block
+static bool esp_queue_message(const uint8_t * data, size_t len) {
+    xSemaphoreTake(command_ring_lock, portMAX_DELAY);
+    if(len > COMMAND_MESSAGE_MAX) {
+        // longer than the fill task can take, drop it here where the host can see it
+        command_ring.drops++;
+        xSemaphoreGive(command_ring_lock);
+        return false;
+    }
+    bool queued = amychip_ring_push(&command_ring, data, len);
+    uint32_t used = amychip_ring_used(&command_ring);
+    if(!command_ring_high && used > COMMAND_RING_HIGH) {
+        command_ring_high = 1;
+        amychip_irq_post(AMYCHIP_EVENT_QUEUE_HIGH, used);
+    }
+    xSemaphoreGive(command_ring_lock);
+    return queued;
+}
+
+// The transport's half of AMYCHIP_CMD_UPLOAD. The chunks that follow need the
+// sample to exist, so this waits for the fill task to allocate it.
+static void esp_upload_request(const uint8_t *data, size_t len) {
+    if(len < UPLOAD_BEGIN_LEN) return;
+    uint16_t patch = data[1] | (data[2] << 8);
+    uint32_t samples = get_u32_le(data + 3);
+    if(samples == 0 || samples > UINT32_MAX / 2) {
+        ESP_LOGW(TAG, "can't upload %" PRIu32 " samples to patch %d", samples, patch);
+        xSemaphoreTake(upload_lock, portMAX_DELAY);
+        amychip_upload_fail(&upload, patch);
+        xSemaphoreGive(upload_lock);
+        return;
+    }
+    xSemaphoreTake(upload_lock, portMAX_DELAY);
+    bool carry_on = upload.state == AMYCHIP_UPLOAD_RECEIVING && upload.patch == patch && upload.size == samples * 2;
+    if(carry_on) ESP_LOGI(TAG, "upload to patch %d carries on at %" PRIu32 " of %" PRIu32 " bytes", patch, upload.received, upload.size);
+    xSemaphoreGive(upload_lock);
+    if(carry_on) return;
+    // one that gave up waiting may have started since
+    xQueueReset(upload_started);
+    uint8_t state;
+    if(!esp_queue_message(data, len) || xQueueReceive(upload_started, &state, pdMS_TO_TICKS(UPLOAD_START_TIMEOUT_MS)) != pdTRUE) {
+        ESP_LOGW(TAG, "upload to patch %d didn't start", patch);
+    }
+}
+
+// One message from any transport: chip commands act now, AMY messages wait for the next block
+static void esp_receive_message(const uint8_t * data, size_t len) {
+    if(len == 0) return;
+    if(data[0] == AMYCHIP_CMD_UPLOAD) {
+        esp_upload_request(data, len);
+        return;
+    }
+    if(AMYCHIP_IS_COMMAND(data[0]) && data[0] != AMYCHIP_CMD_EVENT && data[0] != AMYCHIP_CMD_AT) {
+        esp_chip_command((uint8_t *)data, len);
+        return;
+    }
+    esp_queue_message(data, len);
+}
+
+// One write from any transport, its batches carry on in that transport's deframer
+static void esp_receive_write(amychip_batch_t *batch, const uint8_t * data, size_t len) {
+    if(data[0] == AMYCHIP_CMD_BATCH || data[0] == AMYCHIP_CMD_BATCH_MORE) {
+        amychip_batch_feed(batch, data, len, esp_receive_message);
+    } else {
+        esp_receive_message(data, len);
+    }
+}
+
 static void i2c_slave_receive_cb(uint8_t num, uint8_t * data, size_t len, bool stop, void * arg) {
     if (len > 0) {
-        data[len]= 0;
-        amy_play_message((char*)data);
+        esp_receive_write(&i2c_batch, data, len);
+    }
+}
+
+#if SPI_SLAVE_ENABLED
+static void spi_slave_receive(const uint8_t * data, size_t len) {
+    esp_receive_write(&spi_batch, data, len);
+}
+#endif
+
+#if UART_CTRL_ENABLED
+static void uart_ctrl_receive(const uint8_t * data, size_t len) {
+    esp_receive_write(&uart_batch, data, len);
+}
+#endif
+
+void esp_get_batch_stats(uint32_t *records, uint32_t *spanned, uint32_t *errors) {
+    *records = i2c_batch.records + spi_batch.records + uart_batch.records;
+    *spanned = i2c_batch.spanned + spi_batch.spanned + uart_batch.spanned;
+    *errors = i2c_batch.errors + spi_batch.errors + uart_batch.errors;
+}
+
+// Timestamped messages waiting for their block, only touched by the fill task
+static amychip_sched_t schedule;
+
+// The sample clock: samples rendered before the block now rendering, and when
+// that block started. Written by the fill task; a reader retries if it catches
+// the two mid-update (odd sample_clock_seq).
+static uint32_t rendered_samples = 0;
+static volatile uint32_t sample_clock = 0;
+static volatile int64_t sample_clock_us = 0;
+static volatile uint32_t sample_clock_seq = 0;
+
+static void set_sample_clock(uint32_t clock, int64_t at_us) {
+    __atomic_store_n(&sample_clock_seq, sample_clock_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    sample_clock = clock;
+    sample_clock_us = at_us;
+    __atomic_store_n(&sample_clock_seq, sample_clock_seq + 1, __ATOMIC_RELEASE);
+}
+
+// Now on the sample clock, to within the jitter of a block start
+uint32_t esp_get_sample_clock() {
+    uint32_t seq, clock;
+    int64_t at_us;
+    do {
+        seq = __atomic_load_n(&sample_clock_seq, __ATOMIC_ACQUIRE);
+        clock = sample_clock;
+        at_us = sample_clock_us;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while((seq & 1) || seq != __atomic_load_n(&sample_clock_seq, __ATOMIC_RELAXED));
+    uint32_t since = (uint32_t)((esp_timer_get_time() - at_us) * sample_rate / 1000000);
+    return clock + (since < AMY_BLOCK_SIZE ? since : AMY_BLOCK_SIZE);
+}
+
+// One message off the queue or out of the schedule, played now
+static void esp_play_message(char * message, size_t len) {
+    int64_t start = esp_timer_get_time();
+    if((uint8_t)message[0] == AMYCHIP_CMD_EVENT) {
+        amy_event e;
+        if(amychip_wire_decode((uint8_t *)message, len, &e)) {
+            if(AMY_IS_UNSET(e.time)) e.time = amy_sysclock();
+            e.status = EVENT_SCHEDULED;
+            amy_add_event(e);
+        } else {
+            amychip_stats.wire_errors++;
+        }
+        amychip_stats.binary_messages++;
+        amychip_stats.binary_bytes += len;
+        amychip_stats.binary_us += (uint32_t)(esp_timer_get_time() - start);
+    } else if(AMYCHIP_IS_COMMAND((uint8_t)message[0])) {
+        esp_chip_command((uint8_t *)message, len);
+    } else {
+        message[len] = 0;
+        amy_play_message(message);
+        amychip_stats.ascii_messages++;
+        amychip_stats.ascii_bytes += len;
+        amychip_stats.ascii_us += (uint32_t)(esp_timer_get_time() - start);
+    }
+}
+
+// Play everything that was queued before this block started, and everything
+// scheduled for a time nearer this block's start than the next one's
+static void esp_play_queued_messages(uint32_t block_clock) {
+    static char message[COMMAND_MESSAGE_MAX + 1];
+    uint32_t release_before = block_clock + AMY_BLOCK_SIZE / 2;
+    uint32_t waiting = amychip_ring_used(&command_ring);
+    if(upload_begin_pending) esp_upload_try_begin();
+    if(command_ring_high && waiting < COMMAND_RING_LOW) command_ring_high = 0;
+    // whole messages are published at once, so this counts down to exactly 0
+    while(waiting > 0) {
+        size_t len = amychip_ring_pop(&command_ring, (uint8_t *)message, COMMAND_MESSAGE_MAX);
+        waiting -= AMYCHIP_RING_HEADER + len;
+        if(len > COMMAND_MESSAGE_MAX) continue;  // esp_receive_message turns these away
+        if((uint8_t)message[0] == AMYCHIP_CMD_AT) {
+            if(len <= 5) continue;
+            uint32_t time = get_u32_le((uint8_t *)message + 1);
+            if((int32_t)(time - release_before) < 0) {
+                // already due, or late
+                if((int32_t)(time - (block_clock - AMY_BLOCK_SIZE / 2)) < 0) amychip_stats.sched_late++;
+                amychip_stats.sched_messages++;
+                esp_play_message(message + 5, len - 5);
+            } else if(!amychip_sched_add(&schedule, time, (uint8_t *)message + 5, len - 5)) {
+                amychip_stats.sched_drops++;
+            }
+            continue;
+        }
+        esp_play_message(message, len);
+    }
+    uint32_t time;
+    size_t len;
+    while((len = amychip_sched_pop_due(&schedule, release_before, (uint8_t *)message, &time)) > 0) {
+        amychip_stats.sched_messages++;
+        esp_play_message(message, len);
     }
 }
 
+void esp_get_command_ring(amychip_ring_info_t *info) {
+    info->used = amychip_ring_used(&command_ring);
+    info->size = command_ring.size;
+    info->high_water = command_ring.high_water;
+    info->pushed = command_ring.pushed;
+    info->drops = command_ring.drops;
+}
+
+uint32_t esp_get_credits() {
+    return command_ring.size - amychip_ring_used(&command_ring);
+}
+
+void esp_get_i2c_rx_stats(i2c_slave_rx_stats_t *stats) {
+    i2cSlaveGetRxStats(I2C_SLAVE_NUM, stats);
+}
+
+static esp_err_t irq_init(void) {
+    return amychip_irq_init(&AMYCHIP_IRQ_LINE, IRQ_GPIO);
+}
+
+static esp_err_t message_queue_init(void) {
+    amychip_ring_init(&command_ring, command_ring_buf, COMMAND_RING_BYTES);
+    command_ring_lock = xSemaphoreCreateMutex();
+    if(command_ring_lock == NULL) return ESP_ERR_NO_MEM;
+    amychip_batch_init(&i2c_batch);
+    amychip_batch_init(&spi_batch);
+    amychip_batch_init(&uart_batch);
+    amychip_sched_init(&schedule);
+    amychip_upload_init(&upload);
+    upload_lock = xSemaphoreCreateMutex();
+    upload_started = xQueueCreate(1, sizeof(uint8_t));
+    if(upload_lock == NULL || upload_started == NULL) return ESP_ERR_NO_MEM;
+    return ESP_OK;
+}
+
 static esp_err_t i2c_slave_init(void) {
     i2cSlaveAttachCallbacks(I2C_SLAVE_NUM, i2c_slave_request_cb, i2c_slave_receive_cb, NULL);
     return i2cSlaveInit(I2C_SLAVE_NUM, I2C_SLAVE_SDA, I2C_SLAVE_SCL, ESP_SLAVE_ADDR, I2C_CLK_FREQ, I2C_SLAVE_RX_BUF_LEN, I2C_SLAVE_TX_BUF_LEN);
 }
 
+#if SPI_SLAVE_ENABLED
+static esp_err_t spi_slave_init(void) {
+    return amychip_spi_init(SPI_SLAVE_MOSI, SPI_SLAVE_MISO, SPI_SLAVE_SCLK, SPI_SLAVE_CS, spi_slave_receive);
+}
+#endif
+
+#if UART_CTRL_ENABLED
+static esp_err_t uart_ctrl_init(void) {
+    return amychip_uart_init(UART_CTRL_NUM, UART_CTRL_TX, UART_CTRL_RX, UART_CTRL_BAUD, uart_ctrl_receive);
+}
+#endif
+
 
 
 // AMY synth states
 extern struct state amy_global;
 extern uint32_t event_counter;
 extern uint32_t message_counter;
+extern struct synthinfo * synth;
+extern struct mod_synthinfo * msynth;
 
 void esp_show_debug(uint8_t t) {
 
 }
 
+// Oscillators are split between the two render cores every block.
+// Core 0 renders [0, render_split), core 1 renders [render_split, AMY_OSCS).
+// The split is chosen so both halves cost the same according to a running
+// estimate of what each audible oscillator takes to render, which we learn
+// from how long each core's amy_render took.
+#define RENDER_DYNAMIC_SPLIT 1
+#define RENDER_COST_SMOOTHING 0.125f  // weight of the newest measurement
+#define RENDER_COST_DEFAULT_US 5.0f   // guess for an osc we have never timed
+
+static uint16_t render_split = AMY_OSCS/2;
+static float osc_cost_us[AMY_OSCS];
+static volatile uint32_t core_render_us[2];
+static amychip_balance_t render_balance;
+
+static inline uint8_t osc_is_audible(uint16_t osc) {
+    return synth[osc].status == SYNTH_AUDIBLE;
+}
+
+static inline float osc_cost(uint16_t osc) {
+    return osc_cost_us[osc] > 0 ? osc_cost_us[osc] : RENDER_COST_DEFAULT_US;
+}
+
+// Spread the time a core took over the audible oscs it rendered
+static void update_osc_costs(uint16_t start, uint16_t end, uint32_t render_us, uint16_t active) {
+    if(active == 0) return;
+    float per_osc = (float)render_us / active;
+    for(uint16_t osc = start; osc < end; osc++) {
+        if(osc_is_audible(osc)) {
+            if(osc_cost_us[osc] == 0) {
+                osc_cost_us[osc] = per_osc;
+            } else {
+                osc_cost_us[osc] += (per_osc - osc_cost_us[osc]) * RENDER_COST_SMOOTHING;
+            }
+        }
+    }
+}
+
+// Pick the split for the coming block so both cores get half the predicted cost
+static void choose_render_split() {
+    float total = 0;
+    for(uint16_t osc = 0; osc < AMY_OSCS; osc++) {
+        if(osc_is_audible(osc)) total += osc_cost(osc);
+    }
+    float core0 = 0;
+    uint16_t split = 0;
+    while(split < AMY_OSCS) {
+        if(osc_is_audible(split)) {
+            float cost = osc_cost(split);
+            // stop before the osc that would put core 0 further past half than it is short of it
+            if(core0 + cost / 2 > total / 2) break;
+            core0 += cost;
+        }
+        split++;
+    }
+    render_split = split;
+    render_balance.predicted_us[0] = (uint32_t)core0;
+    render_balance.predicted_us[1] = (uint32_t)(total - core0);
+}
+
+static uint16_t count_audible(uint16_t start, uint16_t end) {
+    uint16_t active = 0;
+    for(uint16_t osc = start; osc < end; osc++) {
+        if(osc_is_audible(osc)) active++;
+    }
+    return active;
+}
+
+void esp_get_render_balance(amychip_balance_t *balance) {
+    *balance = render_balance;
+}
+
+// Voice shedding: before each block the fill task checks the predicted render time
+// against the block deadline plus the audio already waiting in the pipeline, and
+// when it won't fit, cuts work by the shed policy instead of letting the DAC
+// underrun. Oscillator policies stop at most SHED_MAX_OSCS voices a block until
+// the prediction fits; the effects policy mutes AMY's reverb, chorus and echo from
+// one block to the next until a block comes in well under budget. Off until the
+// budget has been tuned on hardware.
+#ifndef VOICE_SHED_POLICY
+#define VOICE_SHED_POLICY AMYCHIP_SHED_OFF
+#endif
+#define SHED_BUDGET 0.85f  // share of the block deadline rendering may use
+#define SHED_RESTORE 0.5f  // effects come back once a block takes less than this share
+#define SHED_MAX_OSCS 4    // most oscillators stopped in one block
+
+static volatile uint8_t shed_policy = VOICE_SHED_POLICY;
+static uint32_t mix_overhead_us = 0; // last block's time from the end of the render to the end of the block
+static uint8_t effects_shed = 0;
+static SAMPLE shed_reverb_level, shed_chorus_level, shed_echo_level;
+
+// The next oscillator to stop, or -1 if none are playing
+static int32_t shed_victim(uint8_t policy) {
+    int32_t victim = -1;
+    for(uint16_t osc = 0; osc < AMY_OSCS; osc++) {
+        if(!osc_is_audible(osc)) continue;
+        if(victim < 0 ||
+           (policy == AMYCHIP_SHED_QUIETEST && msynth[osc].amp < msynth[victim].amp) ||
+           (policy == AMYCHIP_SHED_OLDEST && synth[osc].note_on_clock < synth[victim].note_on_clock)) {
+            victim = osc;
+        }
+    }
+    return victim;
+}
+
+// Stop oscillators until the block is predicted to render in time. Message parsing
+// isn't counted: a slow message is paid for by the audio waiting in the pipeline.
+static void shed_oscs(uint8_t policy, uint32_t headroom_us) {
+    float budget = amychip_stats.deadline_us * SHED_BUDGET + (float)headroom_us - mix_overhead_us;
+    float total = (float)render_balance.predicted_us[0] + render_balance.predicted_us[1];
+    // both cores share the work once it's split again
+    if(total / 2 <= budget) return;
+    uint32_t shed = 0;
+    while(total / 2 > budget && shed < SHED_MAX_OSCS) {
+        int32_t victim = shed_victim(policy);
+        if(victim < 0) break;
+        total -= osc_cost(victim);
+        synth[victim].status = SYNTH_OFF;
+        shed++;
+    }
+    if(shed) {
+        amychip_stats.shed_blocks++;
+        amychip_stats.shed_oscs += shed;
+        choose_render_split();
+    }
+}
+
+static void shed_effects(uint8_t mute) {
+    if(mute == effects_shed) return;
+    if(mute) {
+        shed_reverb_level = reverb.level;
+        shed_chorus_level = chorus.level;
+        shed_echo_level = echo.level;
+        reverb.level = 0;
+        chorus.level = 0;
+        echo.level = 0;
+    } else {
+        reverb.level = shed_reverb_level;
+        chorus.level = shed_chorus_level;
+        echo.level = shed_echo_level;
+    }
+    effects_shed = mute;
+}
+
+// Runs on the fill task between amy_prepare_buffer and the render, when nothing else
+// touches the synths. headroom_us is the audio already rendered and waiting to go out.
+static void shed_for_deadline(uint32_t headroom_us) {
+    uint8_t policy = shed_policy;
+    if(policy == AMYCHIP_SHED_EFFECTS) {
+        uint32_t last = amychip_stats.render_us_last;
+        if(!effects_shed && last > amychip_stats.deadline_us * SHED_BUDGET) shed_effects(1);
+        else if(effects_shed && last < amychip_stats.deadline_us * SHED_RESTORE) shed_effects(0);
+    } else {
+        // the policy changed while the effects were muted
+        shed_effects(0);
+        if(policy != AMYCHIP_SHED_OFF) shed_oscs(policy, headroom_us);
+    }
+    if(effects_shed) amychip_stats.effects_shed_blocks++;
+}
+
+esp_err_t esp_set_shed_policy(uint8_t policy) {
+    if(policy >= AMYCHIP_SHED_POLICIES) return ESP_ERR_INVALID_ARG;
+    shed_policy = policy;
+    return ESP_OK;
+}
+
+uint8_t esp_get_shed_policy() {
+    return shed_policy;
+}
+
 // Render the second core
 void esp_render_task( void * pvParameters) {
     while(1) {
         ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-        amy_render(0, AMY_OSCS/2, 1);
+        int64_t start = esp_timer_get_time();
+        amy_render(0, render_split, 1);
+        core_render_us[0] = (uint32_t)(esp_timer_get_time() - start);
         xTaskNotifyGive(alles_fill_buffer_handle);
     }
 }
 
 extern int16_t amy_in_block[AMY_BLOCK_SIZE*AMY_NCHANS];
 
+// Input on demand: while no oscillator is set to an audio input wave the RX channel
+// is disabled and amy_in_block stays silent, so a block costs one blocking I2S call
+// and one DMA stream fewer. It comes back on as soon as an osc is set to AUDIO_IN0/1;
+// the first block after that waits for a full block of fresh capture.
+// Set to 0 to capture every block.
+#ifndef AUDIO_INPUT_ON_DEMAND
+#define AUDIO_INPUT_ON_DEMAND 1
+#endif
+static uint8_t input_enabled = 1;
+
+static uint8_t input_wanted() {
+#if AUDIO_INPUT_ON_DEMAND
+    for(uint16_t osc = 0; osc < AMY_OSCS; osc++) {
+        if(synth[osc].wave == AUDIO_IN0 || synth[osc].wave == AUDIO_IN1) return 1;
+    }
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+static void set_input_enabled(uint8_t enable) {
+    if(enable == input_enabled) return;
+    if(enable) {
+        i2s_channel_enable(rx_handle);
+    } else {
+        i2s_channel_disable(rx_handle);
+        memset(amy_in_block, 0, sizeof(amy_in_block));
+    }
+    input_enabled = enable;
+    ESP_LOGI(TAG, "audio input %s", enable ? "on" : "off");
+}
+
+#if AUDIO_DIRECT_DMA
+// A DMA buffer the TX channel has finished sending, and how many it had sent by then
+typedef struct {
+    int16_t *buf;
+    uint32_t sent;
+} dma_free_t;
+
+// DMA buffers the TX channel has finished sending, in the order it will send them
+// again. Room for two rounds of the ring, so a stalled fill task still finds the
+// newest ones once it has skipped the ones it missed.
+static QueueHandle_t dma_free_queue;
+static volatile uint32_t dma_sent = 0;  // buffers sent since the channel was set up
+static uint32_t dma_late_blocks = 0;
+static uint8_t dma_filling = 0;
+
+static bool IRAM_ATTR i2s_tx_sent_cb(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx) {
+    BaseType_t woken = pdFALSE;
+    dma_free_t free_buf = { .buf = event->dma_buf, .sent = ++dma_sent };
+    xQueueSendFromISR(dma_free_queue, &free_buf, &woken);
+    return woken == pdTRUE;
+}
+
+// The DMA starts on a buffer again once the dma_desc_num - 1 after it have gone,
+// so a block has to be all in by then
+static inline bool dma_missed(const dma_free_t *free_buf) {
+    return (int32_t)(dma_sent - (free_buf->sent + latency_profiles[latency_profile].dma_desc_num - 1)) >= 0;
+}
+
+static void dma_block_late() {
+    if(!dma_filling) return;
+    dma_late_blocks++;
+    amychip_stats.underruns++;
+    amychip_irq_post(AMYCHIP_EVENT_UNDERRUN, amychip_stats.underruns);
+}
+#else
+// The driver had to send a DMA buffer again because we hadn't written the next one
+static bool IRAM_ATTR i2s_tx_q_ovf_cb(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx) {
+    amychip_stats.underruns++;
+    amychip_irq_post(AMYCHIP_EVENT_UNDERRUN, amychip_stats.underruns);
+    return false;
+}
+#endif
+
+#if AUDIO_PIPELINE_DEPTH > 0
+// Block buffers between the fill task and the I2S write task, passed by index.
+// Each holds one I2S transfer, blocks_per_write AMY blocks.
+static int16_t pipeline_blocks[AUDIO_PIPELINE_DEPTH][MAX_BLOCKS_PER_WRITE*AMY_BLOCK_SIZE*AMY_NCHANS];
+static QueueHandle_t pipeline_free_queue;
+static QueueHandle_t pipeline_ready_queue;
+// Buffers beyond the render-ahead depth, out of circulation
+static uint8_t parked_slots[AUDIO_PIPELINE_DEPTH];
+static uint8_t parked_count = 0;
+static uint8_t render_ahead = 0;
+static volatile uint8_t render_ahead_pending = RENDER_AHEAD_AT_BOOT;
+#elif !AUDIO_DIRECT_DMA
+// Gathers blocks for a transfer when the profile renders more than one per write
+static int16_t write_batch[MAX_BLOCKS_PER_WRITE*AMY_BLOCK_SIZE*AMY_NCHANS];
+#endif
+
+amy_err_t setup_i2s(void);
+
+static uint8_t blocks_per_write() {
+#if AUDIO_DIRECT_DMA
+    return 1;
+#else
+    return latency_profiles[latency_profile].blocks_per_write;
+#endif
+}
+
+#if AUDIO_PIPELINE_DEPTH > 0
+// Put a buffer into circulation. While input paces the renderer it can't get
+// ahead on its own, so the buffer goes out as silence to open up the headroom.
+static void pipeline_add_slot(uint8_t slot) {
+    if(input_enabled) {
+        memset(pipeline_blocks[slot], 0, blocks_per_write() * I2S_BLOCK_BYTES);
+        xQueueSend(pipeline_ready_queue, &slot, portMAX_DELAY);
+    } else {
+        xQueueSend(pipeline_free_queue, &slot, portMAX_DELAY);
+    }
+}
+
+// Grow or shrink the buffers in circulation, on the fill task between transfers
+static void apply_render_ahead(uint8_t depth) {
+    uint8_t slot;
+    while(render_ahead > depth) {
+        // waits for the writer to finish with one
+        xQueueReceive(pipeline_free_queue, &slot, portMAX_DELAY);
+        parked_slots[parked_count++] = slot;
+        render_ahead--;
+    }
+    while(render_ahead < depth) {
+        pipeline_add_slot(parked_slots[--parked_count]);
+        render_ahead++;
+    }
+}
+#endif
+
+// Rebuild the I2S channels for a new latency profile or sample rate. Runs on the
+// fill task between transfers, once the write task has nothing left in flight.
+static void rebuild_i2s(uint8_t profile, uint32_t rate) {
+#if AUDIO_PIPELINE_DEPTH > 0
+    uint8_t depth = render_ahead;
+    apply_render_ahead(0);
+#endif
+    i2s_channel_disable(tx_handle);
+    if(input_enabled) i2s_channel_disable(rx_handle);
+    i2s_del_channel(tx_handle);
+    i2s_del_channel(rx_handle);
+#if AUDIO_DIRECT_DMA
+    xQueueReset(dma_free_queue);
+    dma_sent = 0;
+#endif
+    latency_profile = profile;
+    sample_rate = rate;
+    amychip_stats.deadline_us = (uint32_t)((uint64_t)AMY_BLOCK_SIZE * 1000000 / rate);
+    setup_i2s();
+#if AUDIO_PIPELINE_DEPTH > 0
+    apply_render_ahead(depth);
+#endif
+}
+
+static void apply_latency_profile(uint8_t profile) {
+    rebuild_i2s(profile, sample_rate);
+    ESP_LOGI(TAG, "latency profile %s, %" PRIu32 " us output latency", latency_profiles[profile].name, esp_get_output_latency_us());
+}
+
+// On the codec worker, read by the fill task once amychip_codec_done says so
+static void codec_sample_rate_job(uint32_t rate) {
+    sample_rate_result = AMYCHIP_CODEC.set_sample_rate(rate);
+}
+
+// The codec first, on its worker so the fill task never waits on the codec's
+// bus; I2S follows at the first block after the worker is done. A rate the
+// codec can't hit leaves everything as it was.
+static void apply_sample_rate(void) {
+    if(sample_rate_ticket == 0) {
+        sample_rate_changing = sample_rate_pending;
+        // 0 with the job queue full, tried again next block
+        sample_rate_ticket = amychip_codec_run(&codec_sample_rate_job, 0, sample_rate_changing);
+        return;
+    }
+    if(!amychip_codec_done(sample_rate_ticket)) return;
+    sample_rate_ticket = 0;
+    uint32_t rate = sample_rate_changing;
+    if(sample_rate_result != ESP_OK) {
+        ESP_LOGW(TAG, "%s can't run at %" PRIu32 " Hz", AMYCHIP_CODEC.name, rate);
+        // unless the host has asked for another since
+        __atomic_compare_exchange_n(&sample_rate_pending, &rate, sample_rate, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        return;
+    }
+    rebuild_i2s(latency_profile, rate);
+    ESP_LOGI(TAG, "sample rate %" PRIu32 " Hz, AMY renders for %d Hz", rate, AMY_SAMPLE_RATE);
+}
+
+// Read a block of input and render a block of output, returns AMY's output block
+// Tick events on AMY's clock, checked once a block by the fill task
+static volatile uint16_t tick_interval_ms = 0;
+static uint16_t tick_running_ms = 0;
+static uint32_t next_tick_ms = 0;
+
+void esp_set_tick_interval(uint16_t ms) {
+    tick_interval_ms = ms;
+}
+
+uint16_t esp_get_tick_interval() {
+    return tick_interval_ms;
+}
+
+static void esp_tick() {
+    uint32_t now = amy_sysclock();
+    if(tick_running_ms != tick_interval_ms) {
+        // new interval: count it from now
+        tick_running_ms = tick_interval_ms;
+        next_tick_ms = now + tick_running_ms;
+    }
+    if(tick_running_ms == 0 || (int32_t)(now - next_tick_ms) < 0) return;
+    amychip_irq_post(AMYCHIP_EVENT_TICK, now);
+    next_tick_ms += tick_running_ms;
+    // after a stall carry on from now rather than catch up with a burst
+    if((int32_t)(now - next_tick_ms) >= 0) next_tick_ms = now + tick_running_ms;
+}
+
+// Finished audio queued in front of the writer, how late a block may render
+static uint32_t render_ahead_headroom_us() {
+    return (uint32_t)esp_get_render_ahead_ready() * blocks_per_write() * amychip_stats.deadline_us;
+}
+
+static int16_t *esp_render_block() {
+    size_t read = 0;
+    AMY_PROFILE_START(AMY_ESP_FILL_BUFFER)
+    set_input_enabled(input_wanted());
+    int64_t block_start = esp_timer_get_time();
+    if(input_enabled) {
+        i2s_channel_read(rx_handle, amy_in_block, I2S_BLOCK_BYTES, &read, portMAX_DELAY);
+        int64_t t = block_start;
+        block_start = esp_timer_get_time();
+        amychip_stats_read_wait((uint32_t)(block_start - t));
+        if(read != I2S_BLOCK_BYTES) amychip_stats.short_reads++;
+    } else {
+        amychip_stats.input_off_blocks++;
+    }
+
+    // Messages only reach AMY here, between blocks
+    set_sample_clock(rendered_samples, block_start);
+    esp_play_queued_messages(rendered_samples);
+
+    // Get ready to render
+    amy_prepare_buffer();
+#if RENDER_DYNAMIC_SPLIT
+    choose_render_split();
+#endif
+    shed_for_deadline(render_ahead_headroom_us());
+    uint16_t split = render_split;
+    // Tell the other core to start rendering
+    xTaskNotifyGive(amy_render_handle);
+    // Render me
+    int64_t start = esp_timer_get_time();
+    amy_render(split, AMY_OSCS, 0);
+    core_render_us[1] = (uint32_t)(esp_timer_get_time() - start);
+    // Wait for the other core to finish
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    int64_t render_end = esp_timer_get_time();
+
+    // Learn from this block before AMY moves on to the next
+    render_balance.split = split;
+    render_balance.active_oscs[0] = count_audible(0, split);
+    render_balance.active_oscs[1] = count_audible(split, AMY_OSCS);
+    render_balance.render_us[0] = core_render_us[0];
+    render_balance.render_us[1] = core_render_us[1];
+    update_osc_costs(0, split, core_render_us[0], render_balance.active_oscs[0]);
+    update_osc_costs(split, AMY_OSCS, core_render_us[1], render_balance.active_oscs[1]);
+
+    int16_t *block = amy_fill_buffer();
+    AMY_PROFILE_STOP(AMY_ESP_FILL_BUFFER)
+    int64_t block_end = esp_timer_get_time();
+    uint32_t block_us = (uint32_t)(block_end - block_start);
+    mix_overhead_us = (uint32_t)(block_end - render_end);
+    amychip_stats_block(block_us);
+    rendered_samples += AMY_BLOCK_SIZE;
+    esp_tick();
+    return block;
+}
+
 // Make AMY's FABT run forever , as a FreeRTOS task 
 void esp_fill_audio_buffer_task() {
-    size_t read = 0;
+    while(1) {
+        if(latency_profile_pending != latency_profile) {
+            apply_latency_profile(latency_profile_pending);
+        }
+        if(sample_rate_ticket != 0 || sample_rate_pending != sample_rate) {
+            apply_sample_rate();
+        }
+#if AUDIO_DIRECT_DMA
+        // Wait for the DMA to hand back the next buffer to fill. One that's
+        // already going out again played as silence (auto_clear), skip it.
+        dma_free_t free_buf;
+        int64_t t = esp_timer_get_time();
+        for(;;) {
+            xQueueReceive(dma_free_queue, &free_buf, portMAX_DELAY);
+            if(!dma_missed(&free_buf)) break;
+            dma_block_late();
+        }
+        amychip_stats_write_wait((uint32_t)(esp_timer_get_time() - t));
+        // The only copy the block gets on its way to the DAC
+        memcpy(free_buf.buf, esp_render_block(), I2S_BLOCK_BYTES);
+        // Some of it went out before it was all there
+        if(dma_missed(&free_buf)) dma_block_late();
+        dma_filling = 1;
+#elif AUDIO_PIPELINE_DEPTH > 0
+        if(render_ahead_pending != render_ahead) {
+            apply_render_ahead(render_ahead_pending);
+        }
+        uint8_t blocks = blocks_per_write();
+        uint8_t slot;
+        xQueueReceive(pipeline_free_queue, &slot, portMAX_DELAY);
+        for(uint8_t b = 0; b < blocks; b++) {
+            // AMY reuses its block next time, so it's copied into the pipeline slot
+            memcpy(pipeline_blocks[slot] + b * AMY_BLOCK_SIZE * AMY_NCHANS, esp_render_block(), I2S_BLOCK_BYTES);
+        }
+        xQueueSend(pipeline_ready_queue, &slot, portMAX_DELAY);
+#else
+        uint8_t blocks = blocks_per_write();
+        size_t written = 0;
+        int16_t *out = NULL;
+        if(blocks == 1) {
+            out = esp_render_block();
+        } else {
+            for(uint8_t b = 0; b < blocks; b++) {
+                memcpy(write_batch + b * AMY_BLOCK_SIZE * AMY_NCHANS, esp_render_block(), I2S_BLOCK_BYTES);
+            }
+            out = write_batch;
+        }
+        int64_t t = esp_timer_get_time();
+        i2s_channel_write(tx_handle, out, blocks * I2S_BLOCK_BYTES, &written, portMAX_DELAY);
+        amychip_stats_write_wait((uint32_t)(esp_timer_get_time() - t));
+        if(written != blocks * I2S_BLOCK_BYTES) amychip_stats.short_writes++;
+#endif
+    }
+}
+
+#if AUDIO_PIPELINE_DEPTH > 0
+// Drain finished blocks into the I2S DMA, blocking here instead of in the renderer
+void esp_i2s_write_task(void * pvParameters) {
     size_t written = 0;
+    uint8_t slot;
     while(1) {
-        AMY_PROFILE_START(AMY_ESP_FILL_BUFFER)
-        i2s_channel_read(rx_handle, amy_in_block, AMY_BLOCK_SIZE * AMY_BYTES_PER_SAMPLE * AMY_NCHANS, &read, portMAX_DELAY);
-
-        // Get ready to render
-        amy_prepare_buffer();
-        // Tell the other core to start rendering
-        xTaskNotifyGive(amy_render_handle);
-        // Render me
-        amy_render(AMY_OSCS/2, AMY_OSCS, 0);
-        // Wait for the other core to finish
-        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        xQueueReceive(pipeline_ready_queue, &slot, portMAX_DELAY);
+        // The profile can't change while a slot is in flight
+        size_t bytes = blocks_per_write() * I2S_BLOCK_BYTES;
+        int64_t t = esp_timer_get_time();
+        i2s_channel_write(tx_handle, pipeline_blocks[slot], bytes, &written, portMAX_DELAY);
+        amychip_stats_write_wait((uint32_t)(esp_timer_get_time() - t));
+        xQueueSend(pipeline_free_queue, &slot, portMAX_DELAY);
+        if(written != bytes) amychip_stats.short_writes++;
+    }
+}
+#endif
 
-        // Write to i2s
-        int16_t *block = amy_fill_buffer();
-        AMY_PROFILE_STOP(AMY_ESP_FILL_BUFFER)
+// Samples between a block leaving the renderer and reaching the DAC, worst case
+uint32_t esp_get_output_latency_us() {
+    uint32_t frames = esp_get_render_ahead() * blocks_per_write() * AMY_BLOCK_SIZE + i2s_dma_frames;
+    return (uint32_t)((uint64_t)frames * 1000000 / sample_rate);
+}
 
-        i2s_channel_write(tx_handle, block, AMY_BLOCK_SIZE * AMY_BYTES_PER_SAMPLE * AMY_NCHANS, &written, portMAX_DELAY);
+uint32_t esp_get_dma_late_blocks() {
+#if AUDIO_DIRECT_DMA
+    return dma_late_blocks;
+#else
+    return 0;
+#endif
+}
 
-        if(written != AMY_BLOCK_SIZE * AMY_BYTES_PER_SAMPLE * AMY_NCHANS || read != AMY_BLOCK_SIZE * AMY_BYTES_PER_SAMPLE * AMY_NCHANS) {
-            fprintf(stderr,"i2s underrun: [w %d,r %d] vs %d\n", written, read, AMY_BLOCK_SIZE * AMY_BYTES_PER_SAMPLE * AMY_NCHANS);
-        }
+uint8_t esp_get_pipeline_depth() {
+    return AUDIO_PIPELINE_DEPTH;
+}
+
+esp_err_t esp_set_render_ahead(uint8_t depth) {
+#if AUDIO_PIPELINE_DEPTH > 0
+    if(depth < 1 || depth > AUDIO_PIPELINE_DEPTH) return ESP_ERR_INVALID_ARG;
+    render_ahead_pending = depth;
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+uint8_t esp_get_render_ahead() {
+#if AUDIO_PIPELINE_DEPTH > 0
+    return render_ahead;
+#else
+    return 0;
+#endif
+}
+
+uint8_t esp_get_render_ahead_ready() {
+#if AUDIO_PIPELINE_DEPTH > 0
+    return (uint8_t)uxQueueMessagesWaiting(pipeline_ready_queue);
+#else
+    return 0;
+#endif
+}
 
+uint32_t esp_get_render_ahead_latency_us() {
+    uint32_t frames = esp_get_render_ahead() * blocks_per_write() * AMY_BLOCK_SIZE;
+    return (uint32_t)((uint64_t)frames * 1000000 / sample_rate);
+}
+
+esp_err_t esp_set_latency_profile(uint8_t profile) {
+    if(profile >= AMYCHIP_LATENCY_PROFILES) return ESP_ERR_INVALID_ARG;
+    latency_profile_pending = profile;
+    return ESP_OK;
+}
+
+uint8_t esp_get_latency_profile() {
+    return latency_profile;
+}
+
+// AMY renders for AMY_SAMPLE_RATE and can't be told otherwise at runtime, so any
+// other rate would only detune everything; refused until AMY can follow.
+esp_err_t esp_set_sample_rate(uint32_t hz) {
+    if(hz == 0) return ESP_ERR_INVALID_ARG;
+    if(hz != AMY_SAMPLE_RATE || !AMYCHIP_CODEC.can_run_at(hz)) {
+        ESP_LOGW(TAG, "sample rate %" PRIu32 " Hz not supported, AMY renders for %d Hz", hz, AMY_SAMPLE_RATE);
+        return ESP_ERR_NOT_SUPPORTED;
     }
+    sample_rate_pending = hz;
+    return ESP_OK;
+}
+
+uint32_t esp_get_sample_rate() {
+    return sample_rate;
 }
 
 
@@ -209,6 +1388,16 @@ amy_err_t esp_amy_init() {
     // Create the second core rendering task
     xTaskCreatePinnedToCore(&esp_render_task, ALLES_RENDER_TASK_NAME, ALLES_RENDER_TASK_STACK_SIZE, NULL, ALLES_RENDER_TASK_PRIORITY, &amy_render_handle, ALLES_RENDER_TASK_COREID);
 
+#if AUDIO_PIPELINE_DEPTH > 0
+    // All the pipeline slots start out parked, the fill task puts the render-ahead depth in play
+    pipeline_free_queue = xQueueCreate(AUDIO_PIPELINE_DEPTH, sizeof(uint8_t));
+    pipeline_ready_queue = xQueueCreate(AUDIO_PIPELINE_DEPTH, sizeof(uint8_t));
+    for(uint8_t slot = 0; slot < AUDIO_PIPELINE_DEPTH; slot++) {
+        parked_slots[parked_count++] = AUDIO_PIPELINE_DEPTH - 1 - slot;
+    }
+    xTaskCreatePinnedToCore(&esp_i2s_write_task, I2S_WRITE_TASK_NAME, I2S_WRITE_TASK_STACK_SIZE, NULL, I2S_WRITE_TASK_PRIORITY, &i2s_write_handle, I2S_WRITE_TASK_COREID);
+#endif
+
     // Wait for the render tasks to get going before starting the i2s task
     delay_ms(100);
 
@@ -222,10 +1411,19 @@ amy_err_t esp_amy_init() {
 
 // Setup I2S
 amy_err_t setup_i2s(void) {
+    const latency_profile_t *profile = &latency_profiles[latency_profile];
     i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_AUTO, I2S_ROLE_MASTER);
+    chan_cfg.dma_desc_num = profile->dma_desc_num;
+    chan_cfg.dma_frame_num = profile->dma_frame_num;
+#if AUDIO_DIRECT_DMA
+    // One AMY block per descriptor, and silence rather than a stale block if we're late
+    chan_cfg.dma_frame_num = AMY_BLOCK_SIZE;
+    chan_cfg.auto_clear = true;
+#endif
     i2s_new_channel(&chan_cfg, &tx_handle, &rx_handle);
+    i2s_dma_frames = chan_cfg.dma_desc_num * chan_cfg.dma_frame_num;
     i2s_std_config_t std_cfg = {
-        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(AMY_SAMPLE_RATE),
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(sample_rate),
         .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_STEREO),
         .gpio_cfg = {
             .mclk = I2S_GPIO_UNUSED,
@@ -244,9 +1442,24 @@ amy_err_t setup_i2s(void) {
     i2s_channel_init_std_mode(tx_handle, &std_cfg);
     i2s_channel_init_std_mode(rx_handle, &std_cfg);
 
+#if AUDIO_DIRECT_DMA
+    // The DMA starts handing back buffers as soon as the channel is enabled
+    if(dma_free_queue == NULL) {
+        dma_free_queue = xQueueCreate(2 * MAX_DMA_DESC_NUM, sizeof(dma_free_t));
+    }
+    i2s_event_callbacks_t cbs = {
+        .on_sent = i2s_tx_sent_cb,
+    };
+#else
+    i2s_event_callbacks_t cbs = {
+        .on_send_q_ovf = i2s_tx_q_ovf_cb,
+    };
+#endif
+    i2s_channel_register_event_callback(tx_handle, &cbs, NULL);
+
     /* Before writing data, start the TX channel first */
     i2s_channel_enable(tx_handle);
-    i2s_channel_enable(rx_handle);
+    if(input_enabled) i2s_channel_enable(rx_handle);
     return AMY_OK;
 }
 
@@ -279,15 +1492,26 @@ void app_main(void)
 
     printf("Minimum free heap size: %" PRIu32 " bytes\n", esp_get_minimum_free_heap_size());
 
+    amychip_stats_init((uint32_t)((uint64_t)AMY_BLOCK_SIZE * 1000000 / AMY_SAMPLE_RATE));
     check_init(&i2c_master_init, "i2c_master");
+    check_init(&irq_init, "irq");
+    check_init(&message_queue_init, "message_queue");
     check_init(&i2c_slave_init, "i2c_slave");
-    check_init(&setup_wm8960_i2s, "wm8960");
+#if SPI_SLAVE_ENABLED
+    check_init(&spi_slave_init, "spi_slave");
+#endif
+#if UART_CTRL_ENABLED
+    check_init(&uart_ctrl_init, "uart");
+#endif
+    check_init(&codec_init, "codec");
     check_init(&setup_i2s, "i2s");
     esp_amy_init();
     amy_reset_oscs();
+    amychip_regs_update();
 
-
+    // refresh the status registers off the audio path
     while(1) {
         delay_ms(10);
+        amychip_regs_update();
     }
 }
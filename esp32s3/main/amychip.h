@@ -0,0 +1,93 @@
+// amychip.h
+// Chip-level state that the control transports and the host build can query.
+
+#ifndef __AMYCHIP_H__
+#define __AMYCHIP_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "amychip_stats.h"
+#include "amychip_upload.h"
+#include "esp32-hal-i2c-slave.h"
+
+// How the oscillators were split between the two render cores on the last block.
+// Core 0 (esp_render_task) renders oscs [0, split), core 1 (esp_fill_audio_buffer_task)
+// renders [split, AMY_OSCS).
+typedef struct {
+    uint16_t split;
+    uint16_t active_oscs[2];  // audible oscs each core rendered
+    uint32_t render_us[2];    // time each core spent in amy_render
+    uint32_t predicted_us[2]; // what the cost model expected for each core
+} amychip_balance_t;
+
+void esp_get_render_balance(amychip_balance_t *balance);
+
+// Output pipeline: buffers between the renderer and the I2S DMA, and the
+// worst case time from a block finishing its render to it reaching the DAC.
+uint8_t esp_get_pipeline_depth();
+uint32_t esp_get_output_latency_us();
+
+// Direct DMA output: blocks that weren't all in their descriptor buffer by the
+// time the DMA came back to it, so some or all of them played as silence. 0 in
+// other output modes, where the I2S driver's underruns count instead.
+uint32_t esp_get_dma_late_blocks();
+
+// Render-ahead: how many pipeline buffers are in use (1 to esp_get_pipeline_depth(),
+// 0 without a pipeline), how many hold finished audio right now, and the latency
+// they add. A new depth takes effect at the next transfer.
+esp_err_t esp_set_render_ahead(uint8_t depth);
+uint8_t esp_get_render_ahead();
+uint8_t esp_get_render_ahead_ready();
+uint32_t esp_get_render_ahead_latency_us();
+
+// Latency profiles (AMYCHIP_LATENCY_* in amychip_protocol.h) set the I2S transfer
+// size and DMA layout together. A new profile takes effect at the next transfer.
+esp_err_t esp_set_latency_profile(uint8_t profile);
+uint8_t esp_get_latency_profile();
+
+// Reclock the codec, on its worker, then I2S at the first transfer after.
+// ESP_ERR_NOT_SUPPORTED for any rate but AMY_SAMPLE_RATE, which AMY is built
+// for, or one the codec can't hit.
+esp_err_t esp_set_sample_rate(uint32_t hz);
+uint32_t esp_get_sample_rate();
+
+// The ring of AMY messages waiting for the next block boundary
+typedef struct {
+    uint32_t used;        // bytes waiting, including a 2 byte header per message
+    uint32_t size;
+    uint32_t high_water;  // most bytes ever waiting
+    uint32_t pushed;      // messages queued
+    uint32_t drops;       // messages that arrived to a full ring
+} amychip_ring_info_t;
+void esp_get_command_ring(amychip_ring_info_t *info);
+
+// How long the codec driver took to bring the codec up at boot
+uint32_t esp_get_codec_init_us();
+
+// Bytes the host may send before it asks again, over every transport together,
+// see AMYCHIP_CMD_CREDITS
+uint32_t esp_get_credits();
+
+// Times the I2C slave held SCL for want of room, bytes it lost, and how long
+// writes took from their STOP to the receive callback
+void esp_get_i2c_rx_stats(i2c_slave_rx_stats_t *stats);
+
+// Messages that came in batched writes, the ones split across writes, and the ones lost
+void esp_get_batch_stats(uint32_t *records, uint32_t *spanned, uint32_t *errors);
+
+// What the renderer drops when a block won't make its deadline, AMYCHIP_SHED_*
+esp_err_t esp_set_shed_policy(uint8_t policy);
+uint8_t esp_get_shed_policy();
+
+// Samples rendered so far, interpolated within the block rendering now.
+// AMYCHIP_CMD_AT times are on this clock.
+uint32_t esp_get_sample_clock();
+
+// A copy of the sample upload's progress, see AMYCHIP_CMD_UPLOAD
+void esp_get_upload(amychip_upload_t *upload);
+
+// Post an AMYCHIP_EVENT_TICK every this many ms of AMY clock, 0 for none
+void esp_set_tick_interval(uint16_t ms);
+uint16_t esp_get_tick_interval();
+
+#endif
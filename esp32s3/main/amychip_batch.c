@@ -0,0 +1,85 @@
+// amychip_batch.c
+// Batched, length-prefixed messages that can span transfers, see amychip_batch.h
+
+#include <string.h>
+#include "amychip_batch.h"
+#include "amychip_protocol.h"
+
+void amychip_batch_init(amychip_batch_t *batch) {
+    memset(batch, 0, sizeof(amychip_batch_t));
+}
+
+static void batch_reset_record(amychip_batch_t *batch) {
+    batch->have = 0;
+    batch->need = 0;
+    batch->prefix_bytes = 0;
+}
+
+void amychip_batch_feed(amychip_batch_t *batch, const uint8_t *data, size_t len, amychip_batch_deliver_t deliver) {
+    if(len == 0) return;
+    if(data[0] != AMYCHIP_CMD_BATCH_MORE && batch->prefix_bytes) {
+        // a new batch while the last one was mid record
+        batch->errors++;
+        batch_reset_record(batch);
+    }
+    size_t at = 1;
+    while(at < len) {
+        // the length prefix, which can itself be split across transfers
+        if(batch->prefix_bytes == 0) {
+            uint8_t b = data[at++];
+            if(b & 0x80) {
+                batch->need = (b & 0x7f) << 8;
+                batch->prefix_bytes = 1;
+                continue;
+            }
+            batch->need = b;
+            batch->prefix_bytes = 2;
+        } else if(batch->prefix_bytes == 1) {
+            batch->need |= data[at++];
+            batch->prefix_bytes = 2;
+        }
+        if(batch->need == 0) {
+            batch_reset_record(batch);
+            continue;
+        }
+        uint8_t fits = batch->need <= AMYCHIP_BATCH_MAX_RECORD;
+        size_t want = batch->need - batch->have;
+        size_t here = len - at;
+        if(batch->have == 0 && here >= want) {
+            // all of it is in this transfer, deliver it in place
+            if(fits) {
+                deliver(data + at, batch->need);
+                batch->records++;
+            } else {
+                batch->errors++;
+            }
+            at += want;
+            batch_reset_record(batch);
+            continue;
+        }
+        size_t take = here < want ? here : want;
+        if(fits) memcpy(batch->record + batch->have, data + at, take);
+        batch->have += take;
+        at += take;
+        if(batch->have == batch->need) {
+            if(fits) {
+                deliver(batch->record, batch->need);
+                batch->records++;
+                batch->spanned++;
+            } else {
+                batch->errors++;
+            }
+            batch_reset_record(batch);
+        }
+    }
+}
+
+size_t amychip_batch_prefix(uint8_t *out, uint16_t len) {
+    if(len < 0x80) {
+        out[0] = len;
+        return 1;
+    }
+    out[0] = 0x80 | (len >> 8);
+    out[1] = len & 0xff;
+    return 2;
+}
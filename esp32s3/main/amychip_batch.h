@@ -0,0 +1,43 @@
+// amychip_batch.h
+// Many messages per transfer. A batch write is a command byte followed by a
+// stream of length-prefixed records, each one a whole message (ASCII AMY,
+// binary event or chip command):
+//
+//   [AMYCHIP_CMD_BATCH] [len] [message] [len] [message] ...
+//
+// A length under 0x80 is one byte; longer ones are two, [0x80 | len >> 8] [len & 0xff].
+// A record that doesn't fit in one transfer carries on in the next, which
+// starts with AMYCHIP_CMD_BATCH_MORE instead. A new AMYCHIP_CMD_BATCH drops
+// whatever was left unfinished.
+
+#ifndef __AMYCHIP_BATCH_H__
+#define __AMYCHIP_BATCH_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The longest record, bigger ones are skipped
+#define AMYCHIP_BATCH_MAX_RECORD 512
+
+typedef void (*amychip_batch_deliver_t)(const uint8_t *message, size_t len);
+
+typedef struct {
+    uint8_t record[AMYCHIP_BATCH_MAX_RECORD]; // a record split across transfers
+    uint16_t have;        // bytes of the current record so far
+    uint16_t need;        // its length once the prefix is in
+    uint8_t prefix_bytes; // 0 between records, 1 halfway through a 2 byte prefix, 2 in the record
+    uint32_t records;     // messages delivered
+    uint32_t spanned;     // of those, how many came in over more than one transfer
+    uint32_t errors;      // records dropped: too long, or cut off by a new batch
+} amychip_batch_t;
+
+void amychip_batch_init(amychip_batch_t *batch);
+// Feed one transfer starting with AMYCHIP_CMD_BATCH or AMYCHIP_CMD_BATCH_MORE.
+// deliver is called for every complete record, straight from data when it's all there.
+void amychip_batch_feed(amychip_batch_t *batch, const uint8_t *data, size_t len, amychip_batch_deliver_t deliver);
+
+// Framing for the host side: writes the length prefix for a record of len bytes,
+// returns the prefix size.
+size_t amychip_batch_prefix(uint8_t *out, uint16_t len);
+
+#endif
@@ -0,0 +1,78 @@
+// amychip_cobs.c
+// Streaming COBS decoder and encoder, see amychip_cobs.h
+
+#include <string.h>
+#include "amychip_cobs.h"
+
+void amychip_cobs_init(amychip_cobs_t *cobs) {
+    memset(cobs, 0, sizeof(amychip_cobs_t));
+}
+
+static void cobs_reset_frame(amychip_cobs_t *cobs) {
+    cobs->len = 0;
+    cobs->code = 0;
+    cobs->left = 0;
+    cobs->bad = 0;
+}
+
+void amychip_cobs_abort(amychip_cobs_t *cobs) {
+    if(cobs->code) cobs->bad = 1;
+}
+
+static void cobs_put(amychip_cobs_t *cobs, uint8_t b) {
+    if(cobs->len < AMYCHIP_COBS_MAX_FRAME) {
+        cobs->frame[cobs->len++] = b;
+    } else {
+        cobs->bad = 1;
+    }
+}
+
+void amychip_cobs_feed(amychip_cobs_t *cobs, const uint8_t *data, size_t len, amychip_cobs_deliver_t deliver) {
+    for(size_t i = 0; i < len; i++) {
+        uint8_t b = data[i];
+        if(b == 0) {
+            // end of frame; a zero right after another is just idle
+            if(cobs->code) {
+                if(cobs->bad || cobs->left) {
+                    cobs->errors++;
+                } else {
+                    cobs->frames++;
+                    if(cobs->len) deliver(cobs->frame, cobs->len);
+                }
+            }
+            cobs_reset_frame(cobs);
+        } else if(cobs->bad) {
+            continue;
+        } else if(cobs->left == 0) {
+            // a code byte: a block short of 254 stood for a zero, unless it was the last
+            if(cobs->code && cobs->code < 0xff) cobs_put(cobs, 0);
+            cobs->code = b;
+            cobs->left = b - 1;
+        } else {
+            cobs_put(cobs, b);
+            cobs->left--;
+        }
+    }
+}
+
+size_t amychip_cobs_encode(const uint8_t *data, size_t len, uint8_t *out) {
+    size_t code_at = 0, n = 1;
+    uint8_t code = 1;
+    for(size_t i = 0; i < len; i++) {
+        if(data[i] == 0) {
+            out[code_at] = code;
+            code_at = n++;
+            code = 1;
+            continue;
+        }
+        out[n++] = data[i];
+        if(++code == 0xff) {
+            out[code_at] = code;
+            code_at = n++;
+            code = 1;
+        }
+    }
+    out[code_at] = code;
+    out[n++] = 0;
+    return n;
+}
@@ -0,0 +1,39 @@
+// amychip_cobs.h
+// COBS framing for byte streams with no transfer boundaries of their own (UART).
+// Each frame is one write, COBS encoded so it holds no zero bytes, followed by
+// a zero. A receiver that joins mid-stream or loses bytes picks up again at
+// the next zero.
+
+#ifndef __AMYCHIP_COBS_H__
+#define __AMYCHIP_COBS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// The longest decoded frame, longer ones are dropped
+#define AMYCHIP_COBS_MAX_FRAME 2048
+// Worst case encoded size of len bytes, delimiter included
+#define AMYCHIP_COBS_ENCODED_MAX(len) ((len) + (len) / 254 + 2)
+
+typedef void (*amychip_cobs_deliver_t)(const uint8_t *frame, size_t len);
+
+typedef struct {
+    uint8_t frame[AMYCHIP_COBS_MAX_FRAME];
+    uint16_t len;
+    uint8_t code;      // the current block's code byte, 0 before the first
+    uint8_t left;      // data bytes still to come in the current block
+    uint8_t bad;       // this frame is already lost, skip to the next zero
+    uint32_t frames;   // delivered
+    uint32_t errors;   // dropped: cut short, too long, or broken by lost bytes
+} amychip_cobs_t;
+
+void amychip_cobs_init(amychip_cobs_t *cobs);
+// Feed any amount of the stream, deliver is called for every complete frame
+void amychip_cobs_feed(amychip_cobs_t *cobs, const uint8_t *data, size_t len, amychip_cobs_deliver_t deliver);
+// Drop the frame in progress, e.g. after the receiver lost bytes
+void amychip_cobs_abort(amychip_cobs_t *cobs);
+
+// For senders: encodes len bytes and the delimiter into out, returns the size
+size_t amychip_cobs_encode(const uint8_t *data, size_t len, uint8_t *out);
+
+#endif
@@ -0,0 +1,167 @@
+// amychip_codec.c
+// Codec control worker, see amychip_codec.h. Writes wait in a small FIFO in
+// the order their registers were first queued, jobs in another; the worker
+// takes one at a time under a spinlock and sends or runs it with the lock
+// released. A job counts as done once the writes it queued have gone out.
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "amychip_codec.h"
+
+#define CODEC_TASK_STACK_SIZE 4096
+
+typedef struct {
+    uint8_t reg;
+    uint16_t value;
+} codec_write_t;
+
+typedef struct {
+    amychip_codec_job_t job;
+    uint16_t key;
+    uint32_t arg;
+    uint32_t ticket;
+} codec_job_entry_t;
+
+static codec_write_t queue[AMYCHIP_CODEC_QUEUE_LEN];
+static uint32_t queue_head = 0;  // next to send
+static uint32_t queue_count = 0;
+static codec_job_entry_t jobs[AMYCHIP_CODEC_JOBS_LEN];
+static uint32_t jobs_head = 0;
+static uint32_t jobs_count = 0;
+static uint32_t jobs_ticket = 0;  // last handed out
+static uint32_t jobs_done = 0;    // last finished, tickets finish in order
+static amychip_codec_stats_t stats;
+static portMUX_TYPE queue_lock = portMUX_INITIALIZER_UNLOCKED;
+static amychip_codec_write_t codec_write = NULL;
+static TaskHandle_t codec_task_handle = NULL;
+
+// Sends everything waiting
+static void codec_send_writes() {
+    for(;;) {
+        portENTER_CRITICAL(&queue_lock);
+        if(queue_count == 0) {
+            portEXIT_CRITICAL(&queue_lock);
+            return;
+        }
+        codec_write_t w = queue[queue_head];
+        queue_head = (queue_head + 1) % AMYCHIP_CODEC_QUEUE_LEN;
+        stats.pending = --queue_count;
+        portEXIT_CRITICAL(&queue_lock);
+        esp_err_t ret = codec_write(w.reg, w.value);
+        stats.sent++;
+        if(ret != ESP_OK) stats.errors++;
+    }
+}
+
+static bool codec_take_job(codec_job_entry_t *out) {
+    portENTER_CRITICAL(&queue_lock);
+    bool taken = jobs_count > 0;
+    if(taken) {
+        *out = jobs[jobs_head];
+        jobs_head = (jobs_head + 1) % AMYCHIP_CODEC_JOBS_LEN;
+        jobs_count--;
+    }
+    portEXIT_CRITICAL(&queue_lock);
+    return taken;
+}
+
+static void codec_task(void *pv_args) {
+    uint32_t finished = 0;  // ticket of the job whose writes are going out
+    for(;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        for(;;) {
+            codec_send_writes();
+            if(finished) {
+                __atomic_store_n(&jobs_done, finished, __ATOMIC_RELEASE);
+                finished = 0;
+            }
+            codec_job_entry_t j;
+            if(!codec_take_job(&j)) break;
+            j.job(j.arg);
+            stats.jobs++;
+            finished = j.ticket;
+        }
+    }
+}
+
+esp_err_t amychip_codec_init(amychip_codec_write_t write, UBaseType_t priority) {
+    codec_write = write;
+    TaskHandle_t handle;
+    if(xTaskCreate(&codec_task, "codec", CODEC_TASK_STACK_SIZE, NULL, priority, &handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    __atomic_store_n(&codec_task_handle, handle, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+uint32_t amychip_codec_run(amychip_codec_job_t job, uint16_t key, uint32_t arg) {
+    TaskHandle_t handle = __atomic_load_n(&codec_task_handle, __ATOMIC_ACQUIRE);
+    if(handle == NULL) return 0;
+    uint32_t ticket = 0;
+    portENTER_CRITICAL(&queue_lock);
+    for(uint32_t i = 0; i < jobs_count; i++) {
+        codec_job_entry_t *j = &jobs[(jobs_head + i) % AMYCHIP_CODEC_JOBS_LEN];
+        if(j->job == job && j->key == key) {
+            j->arg = arg;
+            ticket = j->ticket;
+            break;
+        }
+    }
+    if(ticket == 0) {
+        if(jobs_count < AMYCHIP_CODEC_JOBS_LEN) {
+            if(++jobs_ticket == 0) jobs_ticket = 1;
+            codec_job_entry_t *j = &jobs[(jobs_head + jobs_count) % AMYCHIP_CODEC_JOBS_LEN];
+            j->job = job;
+            j->key = key;
+            j->arg = arg;
+            j->ticket = ticket = jobs_ticket;
+            jobs_count++;
+        } else {
+            stats.jobs_dropped++;
+        }
+    }
+    portEXIT_CRITICAL(&queue_lock);
+    if(ticket) xTaskNotifyGive(handle);
+    return ticket;
+}
+
+bool amychip_codec_done(uint32_t ticket) {
+    return (int32_t)(__atomic_load_n(&jobs_done, __ATOMIC_ACQUIRE) - ticket) >= 0;
+}
+
+bool amychip_codec_write(uint8_t reg, uint16_t value) {
+    bool taken = true;
+    portENTER_CRITICAL(&queue_lock);
+    uint32_t i;
+    for(i = 0; i < queue_count; i++) {
+        codec_write_t *w = &queue[(queue_head + i) % AMYCHIP_CODEC_QUEUE_LEN];
+        if(w->reg == reg) {
+            w->value = value;
+            stats.merged++;
+            break;
+        }
+    }
+    if(i == queue_count) {
+        if(queue_count < AMYCHIP_CODEC_QUEUE_LEN) {
+            codec_write_t *w = &queue[(queue_head + queue_count) % AMYCHIP_CODEC_QUEUE_LEN];
+            w->reg = reg;
+            w->value = value;
+            stats.pending = ++queue_count;
+            if(queue_count > stats.high_water) stats.high_water = queue_count;
+        } else {
+            stats.dropped++;
+            taken = false;
+        }
+    }
+    if(taken) stats.queued++;
+    portEXIT_CRITICAL(&queue_lock);
+    TaskHandle_t handle = __atomic_load_n(&codec_task_handle, __ATOMIC_ACQUIRE);
+    if(taken && handle) xTaskNotifyGive(handle);
+    return taken;
+}
+
+void amychip_codec_get_stats(amychip_codec_stats_t *out) {
+    portENTER_CRITICAL(&queue_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&queue_lock);
+}
@@ -0,0 +1,84 @@
+// amychip_codec.h
+// Codec drivers, and the control worker that owns the codec once it's up.
+//
+// A driver is a table of hooks, so boards with a different DAC only swap the
+// driver (AMYCHIP_CODEC in amychip.c). Its init sequence is a compile time
+// table of register writes sent back to back.
+//
+// After init, driver hooks run only on a low priority worker task, as jobs
+// (amychip_codec_run), and their register writes are queued and sent from the
+// same task, so a transport or the fill task changing a codec setting never
+// waits on the I2C master. A write to a register that's still waiting replaces
+// its value where it stands, so a fader sweep only sends the latest value; with
+// every slot taken, writes to other registers are dropped. Jobs merge the same
+// way by key. Safe from any task.
+
+#ifndef __AMYCHIP_CODEC_H__
+#define __AMYCHIP_CODEC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#define AMYCHIP_CODEC_QUEUE_LEN 16
+#define AMYCHIP_CODEC_JOBS_LEN 8
+
+// Sends one register write to the codec, from the worker
+typedef esp_err_t (*amychip_codec_write_t)(uint8_t reg, uint16_t value);
+
+// Something to do with the codec, run on the worker
+typedef void (*amychip_codec_job_t)(uint32_t arg);
+
+// Hooks return ESP_ERR_NOT_SUPPORTED for what the codec can't do
+typedef struct {
+    const char *name;
+    esp_err_t (*init)(uint32_t hz);             // up and running at that sample rate
+    esp_err_t (*set_sample_rate)(uint32_t hz);  // ESP_ERR_NOT_SUPPORTED for a rate it can't hit
+    bool (*can_run_at)(uint32_t hz);            // whether set_sample_rate would take it, from any task
+    esp_err_t (*set_volume_db)(int8_t db);      // main output, both channels
+    esp_err_t (*set_mute)(bool mute);
+    esp_err_t (*set_power)(bool on);            // converters and outputs
+    esp_err_t (*control)(uint8_t control, int8_t value);  // codec specific AMYCHIP_CODEC_*, may be NULL
+    // For codecs with registers, NULL for those without: send one now, and
+    // send the rest of them through queue (amychip_codec_write) after init
+    amychip_codec_write_t write_register;
+    void (*queue_writes)(bool (*queue)(uint8_t reg, uint16_t value));
+} amychip_codec_driver_t;
+
+// WM8960 on the I2C master, see amychip_codec_wm8960.c
+extern const amychip_codec_driver_t amychip_codec_wm8960;
+// A DAC with no control bus that follows the I2S clocks, see amychip_codec_i2s.c
+extern const amychip_codec_driver_t amychip_codec_i2s_dac;
+
+typedef struct {
+    uint32_t queued;      // writes taken
+    uint32_t merged;      // of those, ones that replaced a write still waiting
+    uint32_t dropped;     // writes refused, every slot was taken
+    uint32_t sent;        // writes the worker sent
+    uint32_t errors;      // of those, ones that failed
+    uint16_t pending;     // registers waiting right now
+    uint16_t high_water;  // most ever waiting
+    uint32_t jobs;        // jobs run
+    uint32_t jobs_dropped;  // jobs refused, the job queue was full
+} amychip_codec_stats_t;
+
+// write is NULL for a codec with no registers; the worker still runs its jobs
+esp_err_t amychip_codec_init(amychip_codec_write_t write, UBaseType_t priority);
+
+// Run job(arg) on the worker after the writes already waiting. A job still
+// waiting with the same function and key takes the new arg instead. Returns a
+// ticket for amychip_codec_done, or 0 if the worker isn't up or the job queue
+// is full.
+uint32_t amychip_codec_run(amychip_codec_job_t job, uint16_t key, uint32_t arg);
+
+// True once the job with that ticket has run and the register writes it
+// queued have been sent. What the job stored is visible to the caller then.
+bool amychip_codec_done(uint32_t ticket);
+
+// Queue reg = value. Returns false if it was dropped.
+bool amychip_codec_write(uint8_t reg, uint16_t value);
+
+void amychip_codec_get_stats(amychip_codec_stats_t *stats);
+
+#endif
@@ -0,0 +1,44 @@
+// amychip_codec_i2s.c
+// A DAC with no control bus, like the PCM5102A or UDA1334A. It takes its
+// format and sample rate from the I2S clocks, so there is nothing to set up.
+// It has no volume of its own, and its mute and power pins (if it has them)
+// aren't wired to the chip.
+
+#include "amychip_codec.h"
+
+static esp_err_t codec_init(uint32_t hz) {
+    return ESP_OK;
+}
+
+static esp_err_t codec_set_sample_rate(uint32_t hz) {
+    return ESP_OK;
+}
+
+static bool codec_can_run_at(uint32_t hz) {
+    return true;
+}
+
+static esp_err_t codec_set_volume_db(int8_t db) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+static esp_err_t codec_set_mute(bool mute) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+static esp_err_t codec_set_power(bool on) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+const amychip_codec_driver_t amychip_codec_i2s_dac = {
+    .name = "i2s dac",
+    .init = &codec_init,
+    .set_sample_rate = &codec_set_sample_rate,
+    .can_run_at = &codec_can_run_at,
+    .set_volume_db = &codec_set_volume_db,
+    .set_mute = &codec_set_mute,
+    .set_power = &codec_set_power,
+    .control = NULL,
+    .write_register = NULL,
+    .queue_writes = NULL,
+};
@@ -0,0 +1,162 @@
+// amychip_codec_wm8960.c
+// The WM8960 driver. It runs as an I2S peripheral, 16 bit, with its SYSCLK
+// from the PLL off the 24 MHz MCLK. INPUT1 goes to the ADCs, and the DACs go
+// out on OUT1 (headphone) and OUT3 at line level. The register writes are in
+// wm8960.c.
+//
+// Clocking: SYSCLK = 256 fs x DACDIV (ADCDIV the same). The PLL's output f2 is
+// 4 x SYSCLKDIV (2) x SYSCLK and has to be 90 to 100 MHz, so SYSCLK has to be
+// 11.25 to 12.5 MHz. The PLL runs off MCLK / 2: f2 = N.K x 12 MHz, N whole
+// and K a 24 bit fraction.
+
+#include "wm8960.h"
+#include "amychip_protocol.h"
+#include "amychip_codec.h"
+
+#define TABLE_LEN(t) (sizeof(t) / sizeof((t)[0]))
+
+#define WM8960_MCLK_HZ 24000000
+#define PLL_IN_HZ (WM8960_MCLK_HZ / 2)
+#define PLL_OUT_MIN_HZ 90000000
+#define PLL_OUT_MAX_HZ 100000000
+
+// What DACDIV and ADCDIV settings 0 to 6 divide SYSCLK by, in halves
+static const uint8_t rate_div_halves[] = { 2, 3, 4, 6, 8, 11, 12 };
+
+typedef struct {
+    uint8_t div;  // DACDIV and ADCDIV
+    uint8_t n;
+    uint32_t k;
+} pll_setting_t;
+
+// False for a rate no divider brings into the PLL's range. Any other is hit to
+// within K's 24 bits, under 0.01 ppm: 44.1 kHz is N 7, K 0x86C226 and 48 kHz
+// is N 8, K 0x3126E9, with no divider; 22.05 kHz and 24 kHz divide by 2.
+static bool pll_for_rate(uint32_t hz, pll_setting_t *pll) {
+    for(uint8_t div = 0; div < sizeof(rate_div_halves); div++) {
+        uint64_t f2 = (uint64_t)hz * 256 * 8 * rate_div_halves[div] / 2;
+        if(f2 < PLL_OUT_MIN_HZ || f2 > PLL_OUT_MAX_HZ) continue;
+        pll->div = div;
+        pll->n = f2 / PLL_IN_HZ;
+        pll->k = (uint32_t)(((f2 % PLL_IN_HZ) << 24) / PLL_IN_HZ);
+        return true;
+    }
+    return false;
+}
+
+// Power and references first, then the input path, the output mixers, the
+// clocks, and the converters and outputs last
+static const wm8960_reg_t init_table[] = {
+    { WM8960_REG_PWR_MGMT_1,          0x0C0 }, // VREF, VMID 2x50k
+    { WM8960_REG_PWR_MGMT_3,          0x030 }, // left and right input PGAs
+    { WM8960_REG_ADCL_SIGNAL_PATH,    0x108 }, // LINPUT1 to the PGA, PGA to the boost mixer
+    { WM8960_REG_ADCR_SIGNAL_PATH,    0x108 },
+    { WM8960_REG_LEFT_INPUT_VOLUME,   0x117 }, // PGAs unmuted at 0 dB, update both
+    { WM8960_REG_RIGHT_INPUT_VOLUME,  0x117 },
+    { WM8960_REG_PWR_MGMT_1,          0x0F0 }, // + input boost mixers
+    { WM8960_REG_BYPASS_1,            0x070 }, // boost mixer bypass off, -21 dB
+    { WM8960_REG_BYPASS_2,            0x070 },
+    { WM8960_REG_LEFT_OUT_MIX_1,      0x150 }, // DAC to the output mixers
+    { WM8960_REG_RIGHT_OUT_MIX_2,     0x150 },
+    { WM8960_REG_PWR_MGMT_3,          0x03C }, // + output mixers
+    { WM8960_REG_PWR_MGMT_2,          0x001 }, // PLL
+    { WM8960_REG_PLL_N,               0x037 }, // fractional, MCLK / 2, N and K for 44.1 kHz
+    { WM8960_REG_PLL_K_1,             0x086 }, // until codec_set_sample_rate sets the rate asked for
+    { WM8960_REG_PLL_K_2,             0x0C2 },
+    { WM8960_REG_PLL_K_3,             0x026 },
+    { WM8960_REG_CLOCKING_1,          0x005 }, // SYSCLK from the PLL / 2
+    { WM8960_REG_CLOCKING_2,          0x1C4 }, // class D clock / 16, BCLK = SYSCLK / 4
+    { WM8960_REG_AUDIO_INTERFACE_1,   0x002 }, // I2S, 16 bit, peripheral
+    { WM8960_REG_PWR_MGMT_1,          0x0FC }, // + ADCs
+    { WM8960_REG_PWR_MGMT_2,          0x181 }, // + DACs
+    { WM8960_REG_ADC_DAC_CTRL_1,      0x000 }, // DAC unmuted
+    { WM8960_REG_AUDIO_INTERFACE_2,   0x000 }, // no loopback
+    { WM8960_REG_PWR_MGMT_2,          0x1E3 }, // + OUT1 and OUT3
+    { WM8960_REG_LOUT1_VOLUME,        0x179 }, // headphones at 0 dB, line level, update both
+    { WM8960_REG_ROUT1_VOLUME,        0x179 },
+};
+
+// The converters and outputs down, and back up as init left them
+static const wm8960_reg_t power_off_table[] = {
+    { WM8960_REG_PWR_MGMT_2,          0x001 }, // only the PLL
+    { WM8960_REG_PWR_MGMT_3,          0x000 },
+    { WM8960_REG_PWR_MGMT_1,          0x0C0 }, // VREF and VMID stay up so coming back doesn't pop
+};
+
+static const wm8960_reg_t power_on_table[] = {
+    { WM8960_REG_PWR_MGMT_1,          0x0FC },
+    { WM8960_REG_PWR_MGMT_3,          0x03C },
+    { WM8960_REG_PWR_MGMT_2,          0x1E3 },
+};
+
+static bool codec_can_run_at(uint32_t hz) {
+    pll_setting_t pll;
+    return pll_for_rate(hz, &pll);
+}
+
+static esp_err_t codec_set_sample_rate(uint32_t hz) {
+    pll_setting_t pll;
+    if(!pll_for_rate(hz, &pll)) return ESP_ERR_NOT_SUPPORTED;
+    setPLLN(pll.n);
+    setPLLK(pll.k >> 16, (pll.k >> 8) & 0xff, pll.k & 0xff);
+    setDACDIV(pll.div);
+    setADCDIV(pll.div);
+    return ESP_OK;
+}
+
+static esp_err_t codec_init(uint32_t hz) {
+    esp_err_t ret = wm8960_init();
+    if(ret != ESP_OK) return ret;
+    wm8960_batch_begin();
+    wm8960_write_table(init_table, TABLE_LEN(init_table));
+    ret = codec_set_sample_rate(hz);
+    esp_err_t sent = wm8960_batch_end();
+    return ret == ESP_OK ? sent : ret;
+}
+
+static esp_err_t codec_set_volume_db(int8_t db) {
+    setHeadphoneVolumeDB(db);
+    return ESP_OK;
+}
+
+static esp_err_t codec_set_mute(bool mute) {
+    if(mute) enableDacMute(); else disableDacMute();
+    return ESP_OK;
+}
+
+static esp_err_t codec_set_power(bool on) {
+    if(on) {
+        wm8960_write_table(power_on_table, TABLE_LEN(power_on_table));
+    } else {
+        enableDacMute();
+        wm8960_write_table(power_off_table, TABLE_LEN(power_off_table));
+    }
+    return ESP_OK;
+}
+
+static esp_err_t codec_control(uint8_t control, int8_t value) {
+    switch(control) {
+        case AMYCHIP_CODEC_DAC_DB:
+            setDacLeftDigitalVolumeDB(value);
+            setDacRightDigitalVolumeDB(value);
+            return ESP_OK;
+        case AMYCHIP_CODEC_LOOPBACK:
+            if(value) enableLoopBack(); else disableLoopBack();
+            return ESP_OK;
+        default:
+            return ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+const amychip_codec_driver_t amychip_codec_wm8960 = {
+    .name = "wm8960",
+    .init = &codec_init,
+    .set_sample_rate = &codec_set_sample_rate,
+    .can_run_at = &codec_can_run_at,
+    .set_volume_db = &codec_set_volume_db,
+    .set_mute = &codec_set_mute,
+    .set_power = &codec_set_power,
+    .control = &codec_control,
+    .write_register = &wm8960_write_register_now,
+    .queue_writes = &wm8960_set_async,
+};
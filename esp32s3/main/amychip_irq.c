@@ -0,0 +1,79 @@
+// amychip_irq.c
+// The event FIFO has producers on several tasks and in the I2S interrupt, so it
+// takes a spinlock rather than being lock-free like the command ring. The line
+// is set under the same lock, so it always agrees with whether events are waiting.
+
+#include "freertos/FreeRTOS.h"
+#include "amychip_protocol.h"
+#include "amychip_irq.h"
+
+typedef struct {
+    uint8_t type;
+    uint32_t value;
+} amychip_irq_event_t;
+
+static amychip_irq_event_t fifo[AMYCHIP_IRQ_FIFO_LEN];
+static uint32_t fifo_head = 0;  // next to pop
+static uint32_t fifo_count = 0;
+static uint32_t posted = 0;
+static uint32_t drops = 0;
+static portMUX_TYPE fifo_lock = portMUX_INITIALIZER_UNLOCKED;
+static const amychip_irq_line_t *irq_line = NULL;
+static int irq_gpio = -1;
+
+esp_err_t amychip_irq_init(const amychip_irq_line_t *line, int gpio) {
+    irq_line = line;
+    irq_gpio = gpio;
+    return line->init(gpio);
+}
+
+// A newer value says all the older one did, so only the newest need wait
+static inline bool event_merges(uint8_t type) {
+    return type != AMYCHIP_EVENT_UPLOAD_DONE;
+}
+
+void amychip_irq_post(uint8_t type, uint32_t value) {
+    portENTER_CRITICAL_SAFE(&fifo_lock);
+    posted++;
+    amychip_irq_event_t *newest = &fifo[(fifo_head + fifo_count - 1) % AMYCHIP_IRQ_FIFO_LEN];
+    if(fifo_count > 0 && newest->type == type && event_merges(type)) {
+        newest->value = value;
+    } else if(fifo_count < AMYCHIP_IRQ_FIFO_LEN) {
+        amychip_irq_event_t *e = &fifo[(fifo_head + fifo_count) % AMYCHIP_IRQ_FIFO_LEN];
+        e->type = type;
+        e->value = value;
+        if(fifo_count++ == 0 && irq_line) irq_line->set(irq_gpio, true);
+    } else {
+        drops++;
+    }
+    portEXIT_CRITICAL_SAFE(&fifo_lock);
+}
+
+size_t amychip_irq_pop(uint8_t *out, size_t max_events) {
+    size_t n = 0;
+    portENTER_CRITICAL_SAFE(&fifo_lock);
+    while(n < max_events && fifo_count > 0) {
+        amychip_irq_event_t *e = &fifo[fifo_head];
+        uint8_t *o = out + n * AMYCHIP_EVENT_BYTES;
+        o[0] = e->type;
+        for(int i = 0; i < 4; i++) o[1 + i] = (e->value >> (8 * i)) & 0xff;
+        fifo_head = (fifo_head + 1) % AMYCHIP_IRQ_FIFO_LEN;
+        fifo_count--;
+        n++;
+    }
+    if(n > 0 && fifo_count == 0 && irq_line) irq_line->set(irq_gpio, false);
+    portEXIT_CRITICAL_SAFE(&fifo_lock);
+    return n;
+}
+
+uint32_t amychip_irq_pending(void) {
+    return fifo_count;
+}
+
+uint32_t amychip_irq_posted(void) {
+    return posted;
+}
+
+uint32_t amychip_irq_drops(void) {
+    return drops;
+}
@@ -0,0 +1,43 @@
+// amychip_irq.h
+// Chip-to-host events. Anything on the chip can post an event; it goes into a
+// small FIFO and the interrupt line is asserted until the host has read the
+// FIFO empty with AMYCHIP_CMD_EVENTS. Posting is safe from tasks and ISRs.
+//
+// The line itself is a backend, so the same FIFO logic drives an open-drain
+// GPIO on the chip and a simulated pin on the host build.
+
+#ifndef __AMYCHIP_IRQ_H__
+#define __AMYCHIP_IRQ_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define AMYCHIP_IRQ_FIFO_LEN 32
+
+typedef struct {
+    esp_err_t (*init)(int gpio);          // leaves the line released
+    void (*set)(int gpio, bool asserted); // called with interrupts off, keep it short
+} amychip_irq_line_t;
+
+// Open drain, asserted low, see amychip_irq_gpio.c
+extern const amychip_irq_line_t amychip_irq_gpio;
+
+esp_err_t amychip_irq_init(const amychip_irq_line_t *line, int gpio);
+
+// Queue an event (AMYCHIP_EVENT_*) and assert the line. If the newest event
+// still waiting is the same type its value is updated instead, so a steady
+// stream of ticks or underruns takes one slot. Events that name something
+// rather than report a level (an upload's patch) always take their own.
+void amychip_irq_post(uint8_t type, uint32_t value);
+
+// Take up to max_events events as AMYCHIP_EVENT_BYTES records into out,
+// releasing the line once the FIFO is empty. Returns the events taken.
+size_t amychip_irq_pop(uint8_t *out, size_t max_events);
+
+uint32_t amychip_irq_pending(void);
+uint32_t amychip_irq_posted(void);
+uint32_t amychip_irq_drops(void);
+
+#endif
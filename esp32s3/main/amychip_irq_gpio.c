@@ -0,0 +1,28 @@
+// amychip_irq_gpio.c
+// The interrupt line as an open-drain GPIO: released (high, pulled up on the
+// host side) when idle, driven low while events are waiting. Several chips can
+// share one host input.
+
+#include "driver/gpio.h"
+#include "amychip_irq.h"
+
+static esp_err_t irq_gpio_init(int gpio) {
+    gpio_config_t conf = {
+        .pin_bit_mask = 1ULL << gpio,
+        .mode = GPIO_MODE_OUTPUT_OD,
+        .pull_up_en = GPIO_PULLUP_DISABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_DISABLE,
+    };
+    gpio_set_level(gpio, 1);
+    return gpio_config(&conf);
+}
+
+static void irq_gpio_set(int gpio, bool asserted) {
+    gpio_set_level(gpio, asserted ? 0 : 1);
+}
+
+const amychip_irq_line_t amychip_irq_gpio = {
+    .init = irq_gpio_init,
+    .set = irq_gpio_set,
+};
@@ -0,0 +1,172 @@
+// amychip_protocol.h
+// What goes over the wire to the chip besides AMY's ASCII messages.
+// AMY messages are plain ASCII, so a write whose first byte has the top bit set
+// is a chip command instead: [command byte, arguments...]
+
+#ifndef __AMYCHIP_PROTOCOL_H__
+#define __AMYCHIP_PROTOCOL_H__
+
+#define AMYCHIP_IS_COMMAND(first_byte) ((first_byte) & 0x80)
+
+// [0x80, profile] pick a latency profile, applied at the next block boundary
+#define AMYCHIP_CMD_LATENCY_PROFILE 0x80
+
+// Latency profiles, smallest output latency first
+#define AMYCHIP_LATENCY_LOW        0
+#define AMYCHIP_LATENCY_DEFAULT    1
+#define AMYCHIP_LATENCY_THROUGHPUT 2
+#define AMYCHIP_LATENCY_PROFILES   3
+
+// [0x81, policy] what to drop when a block won't render before its deadline
+#define AMYCHIP_CMD_SHED_POLICY 0x81
+
+// Voice shedding policies
+#define AMYCHIP_SHED_OFF      0  // render everything, underrun if need be
+#define AMYCHIP_SHED_QUIETEST 1  // stop the quietest oscillators
+#define AMYCHIP_SHED_OLDEST   2  // stop the longest playing oscillators
+#define AMYCHIP_SHED_EFFECTS  3  // mute reverb, chorus and echo until there's room again
+#define AMYCHIP_SHED_POLICIES 4
+
+// [0x82, buffers] how many transfers the renderer may run ahead of the I2S DMA
+#define AMYCHIP_CMD_RENDER_AHEAD 0x82
+
+// [0x83, reg] point status register reads at reg, see the map below.
+// A read with no write before it starts at the last reg pointed at.
+#define AMYCHIP_CMD_REGISTER 0x83
+
+// [0x84, max] as the write half of a write-then-read: read back [count, events...],
+// up to max of the events waiting, oldest first. The interrupt line stays
+// asserted until a read takes the last one.
+#define AMYCHIP_CMD_EVENTS 0x84
+
+// [0x85, ms lo, ms hi] post a tick event every that many ms of AMY clock, 0 for none
+#define AMYCHIP_CMD_TICK 0x85
+
+// [0x86, host time as u32 little endian] as the write half of a write-then-read:
+// read back [host time, chip sample clock, sample rate], u32 little endian each.
+// The sample clock counts samples rendered, read when the request arrived, so
+// the host can line its own clock up with it and track the drift between them.
+#define AMYCHIP_CMD_CLOCK 0x86
+
+// [0x87, patch u16, samples u32, sample rate u32, midi note, loop start u32, loop end u32]
+// start a binary upload of a mono 16 bit sample into memorypcm patch, see
+// amychip_upload.h. Sent again for the upload in progress (same patch and
+// length) it carries on from what has arrived instead of starting over.
+#define AMYCHIP_CMD_UPLOAD 0x87
+// [0x88, byte offset u32, CRC-32 of the data u32, data...] a chunk of the sample.
+// Refused if its CRC doesn't match or it starts past what has arrived so far.
+#define AMYCHIP_CMD_UPLOAD_CHUNK 0x88
+// [0x89] as the write half of a write-then-read: read back
+// [state, patch u16, bytes received u32, bytes expected u32, chunks refused u32]
+#define AMYCHIP_CMD_UPLOAD_STATUS 0x89
+
+// [0x8a] as the write half of a write-then-read: read back
+// [credits u32, messages dropped u32]. Credits are the message queue's free
+// bytes right now; every message queued costs its length plus 2 (each write
+// that isn't a batch or a chip command, and each message in a batch). Over
+// I2C every write before the read has been queued by the time it's served, so
+// a host that spends no more than it was given between reads never loses a
+// message. Chip commands cost nothing. The queue is shared by I2C, SPI and
+// UART, so credits cover all three together: with more than one in use, the
+// host has to split them itself. Drops count messages lost to a full queue
+// and AMYCHIP_CMD_AT messages refused by a full schedule, which credits don't
+// cover: keep no more than the schedule's 64 of those waiting.
+#define AMYCHIP_CMD_CREDITS 0x8A
+
+// [0x8b, control, value] change a codec setting. The change is made later by a
+// low priority worker, so the command never waits on the codec's bus; a newer
+// value for a control or register still waiting replaces the older one.
+#define AMYCHIP_CMD_CODEC 0x8B
+
+// Codec controls, any codec
+#define AMYCHIP_CODEC_VOLUME_DB    0  // value: int8 dB, the main output, both channels
+#define AMYCHIP_CODEC_MUTE         1  // value: 1 mute, 0 unmute
+#define AMYCHIP_CODEC_POWER        2  // value: 0 mutes and powers the converters and outputs down, 1 back up still muted
+// Only some codecs have these
+#define AMYCHIP_CODEC_DAC_DB       3  // value: int8 dB, both channels' digital volume
+#define AMYCHIP_CODEC_LOOPBACK     4  // value: 1 to route the ADC straight to the DAC
+
+// [0x8c, rate u32] reclock the codec to rate Hz, then I2S once the codec's
+// worker has done it. AMY renders for the rate it was built with and can't
+// change it at runtime, so any other rate is refused, as is one the codec can't
+// run at exactly. As the write half of a read it answers [result i32, rate u32]:
+// the esp_err_t (0 taken, 0x106 not supported) and the rate running now, see
+// also AMYCHIP_REG_SAMPLE_RATE.
+#define AMYCHIP_CMD_SAMPLE_RATE 0x8C
+
+// Upload states
+#define AMYCHIP_UPLOAD_IDLE      0
+#define AMYCHIP_UPLOAD_RECEIVING 1
+#define AMYCHIP_UPLOAD_DONE      2
+#define AMYCHIP_UPLOAD_FAILED    3  // no room for the sample
+
+// Events, AMYCHIP_EVENT_BYTES each: [type, value as u32 little endian]
+#define AMYCHIP_EVENT_BYTES       5
+#define AMYCHIP_EVENT_TICK        1  // value: AMY clock in ms
+#define AMYCHIP_EVENT_QUEUE_HIGH  2  // message queue passed 3/4 full, value: bytes waiting
+#define AMYCHIP_EVENT_UNDERRUN    3  // value: underruns so far
+#define AMYCHIP_EVENT_UPLOAD_DONE 4  // value: the patch, all of it has arrived
+
+// [0x90, osc lo, osc hi, (field, value)...] an AMY event in binary,
+// queued and played at the next block like an ASCII message, see amychip_wire.h
+#define AMYCHIP_CMD_EVENT 0x90
+
+// [0x91, (len, message)...] several messages in one write, see amychip_batch.h
+#define AMYCHIP_CMD_BATCH 0x91
+// [0x92, ...] the rest of a batch whose last message didn't fit in the previous write
+#define AMYCHIP_CMD_BATCH_MORE 0x92
+
+// [0x93, sample clock as u32 little endian, message...] play a message (ASCII,
+// binary event or chip command) at that time on the chip's sample clock, see
+// AMYCHIP_CMD_CLOCK. It takes effect at the block boundary nearest that time,
+// within AMY_BLOCK_SIZE / 2 samples of it; AMY can't apply it mid-block.
+#define AMYCHIP_CMD_AT 0x93
+
+// Status registers, little endian. A read starts at the register pointed at and
+// runs on through the map; past the end it reads 0. The chip refreshes them
+// every few ms, so a read is a consistent snapshot that never waits on the audio.
+#define AMYCHIP_PROTOCOL_VERSION 1
+
+#define AMYCHIP_REG_VERSION        0x00  // u16 AMYCHIP_PROTOCOL_VERSION
+#define AMYCHIP_REG_CAPABILITIES   0x02  // u16 AMYCHIP_CAP_* bits
+#define AMYCHIP_REG_LOAD_CORE0     0x04  // u8  % of the block deadline core 0 spent rendering
+#define AMYCHIP_REG_LOAD_CORE1     0x05  // u8  same for core 1, which also mixes and plays messages
+#define AMYCHIP_REG_LATENCY        0x06  // u8  latency profile
+#define AMYCHIP_REG_SHED_POLICY    0x07  // u8  voice shedding policy
+#define AMYCHIP_REG_UNDERRUNS      0x08  // u32 blocks the DAC needed before they were ready
+#define AMYCHIP_REG_QUEUE_USED     0x0C  // u16 message queue bytes waiting
+#define AMYCHIP_REG_QUEUE_SIZE     0x0E  // u16 message queue size in bytes
+#define AMYCHIP_REG_QUEUE_DROPS    0x10  // u32 messages dropped on a full queue
+#define AMYCHIP_REG_FREE_PSRAM     0x14  // u32 bytes
+#define AMYCHIP_REG_ACTIVE_VOICES  0x18  // u16 audible oscillators
+#define AMYCHIP_REG_RENDER_AHEAD   0x1A  // u8  render-ahead transfers
+#define AMYCHIP_REG_EVENTS         0x1B  // u8  events waiting to be read
+#define AMYCHIP_REG_BLOCKS         0x1C  // u32 blocks rendered
+#define AMYCHIP_REG_SNAPSHOT       0x20  // u32 counts snapshots, to tell a fresh read from a stale one
+#define AMYCHIP_REG_RX_STRETCHES   0x24  // u32 times the I2C slave held SCL for want of buffer room
+#define AMYCHIP_REG_RX_LOST        0x28  // u32 I2C bytes lost for want of buffer room
+#define AMYCHIP_REG_RX_DISPATCH_US 0x2C  // u16 us from the last I2C write's STOP to its callback
+#define AMYCHIP_REG_RX_DISPATCH_MAX 0x2E // u16 the most that has taken
+#define AMYCHIP_REG_CODEC_MERGED   0x30  // u32 codec writes replaced by a newer one before they went out
+#define AMYCHIP_REG_CODEC_DROPPED  0x34  // u32 codec writes dropped, the codec queue was full
+#define AMYCHIP_REG_CODEC_PENDING  0x38  // u16 codec registers waiting to be written
+#define AMYCHIP_REG_SAMPLE_RATE    0x3C  // u32 Hz I2S and the codec run at
+#define AMYCHIP_REGS_SIZE          0x40
+
+// Capability bits
+#define AMYCHIP_CAP_BINARY_EVENTS  (1 << 0)  // AMYCHIP_CMD_EVENT
+#define AMYCHIP_CAP_BATCH          (1 << 1)  // AMYCHIP_CMD_BATCH and AMYCHIP_CMD_BATCH_MORE
+#define AMYCHIP_CAP_LATENCY        (1 << 2)  // AMYCHIP_CMD_LATENCY_PROFILE
+#define AMYCHIP_CAP_SHED           (1 << 3)  // AMYCHIP_CMD_SHED_POLICY
+#define AMYCHIP_CAP_RENDER_AHEAD   (1 << 4)  // AMYCHIP_CMD_RENDER_AHEAD, with an output pipeline
+#define AMYCHIP_CAP_AUDIO_INPUT    (1 << 5)  // AUDIO_IN0 and AUDIO_IN1
+#define AMYCHIP_CAP_EVENTS         (1 << 6)  // interrupt line and AMYCHIP_CMD_EVENTS
+#define AMYCHIP_CAP_SPI            (1 << 7)  // messages over SPI too
+#define AMYCHIP_CAP_UART           (1 << 8)  // and over a COBS framed UART
+#define AMYCHIP_CAP_SCHEDULE       (1 << 9)  // AMYCHIP_CMD_AT and AMYCHIP_CMD_CLOCK
+#define AMYCHIP_CAP_UPLOAD         (1 << 10) // AMYCHIP_CMD_UPLOAD and friends
+#define AMYCHIP_CAP_CREDITS        (1 << 11) // AMYCHIP_CMD_CREDITS
+#define AMYCHIP_CAP_CODEC          (1 << 12) // AMYCHIP_CMD_CODEC
+#define AMYCHIP_CAP_SAMPLE_RATE    (1 << 13) // AMYCHIP_CMD_SAMPLE_RATE
+
+#endif
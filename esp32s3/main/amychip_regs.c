@@ -0,0 +1,97 @@
+// amychip_regs.c
+// Double buffered status register snapshot. The updater fills the buffer
+// readers aren't pointed at, then flips them over. A read that took longer
+// than a whole update period could see the next update land in its buffer;
+// at the I2C slave's pace that's a couple of hundred bytes in 10 ms.
+
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "amychip.h"
+#include "amychip_protocol.h"
+#include "amychip_regs.h"
+#include "amychip_irq.h"
+#include "amychip_spi.h"
+#include "amychip_uart.h"
+#include "amychip_codec.h"
+
+static uint8_t regs[2][AMYCHIP_REGS_SIZE];
+static uint32_t regs_current = 0;
+static uint32_t snapshots = 0;
+
+static void put_u8(uint8_t *r, uint8_t reg, uint32_t value) {
+    r[reg] = value > 0xff ? 0xff : (uint8_t)value;
+}
+
+static void put_u16(uint8_t *r, uint8_t reg, uint32_t value) {
+    if(value > 0xffff) value = 0xffff;
+    r[reg] = value & 0xff;
+    r[reg + 1] = value >> 8;
+}
+
+static void put_u32(uint8_t *r, uint8_t reg, uint32_t value) {
+    for(int i = 0; i < 4; i++) r[reg + i] = (value >> (8 * i)) & 0xff;
+}
+
+static uint32_t load_percent(uint32_t us, uint32_t deadline_us) {
+    return deadline_us ? (uint32_t)((uint64_t)us * 100 / deadline_us) : 0;
+}
+
+void amychip_regs_update(void) {
+    uint8_t *r = regs[regs_current ^ 1];
+    amychip_stats_t stats;
+    amychip_balance_t balance;
+    amychip_ring_info_t ring;
+    i2c_slave_rx_stats_t rx;
+    amychip_codec_stats_t codec;
+    amychip_stats_get(&stats);
+    esp_get_render_balance(&balance);
+    esp_get_i2c_rx_stats(&rx);
+    amychip_codec_get_stats(&codec);
+    esp_get_command_ring(&ring);
+
+    uint32_t caps = AMYCHIP_CAP_BINARY_EVENTS | AMYCHIP_CAP_BATCH | AMYCHIP_CAP_LATENCY |
+                    AMYCHIP_CAP_SHED | AMYCHIP_CAP_AUDIO_INPUT | AMYCHIP_CAP_EVENTS |
+                    AMYCHIP_CAP_SCHEDULE | AMYCHIP_CAP_UPLOAD |
+                    AMYCHIP_CAP_CREDITS | AMYCHIP_CAP_CODEC | AMYCHIP_CAP_SAMPLE_RATE;
+    if(esp_get_pipeline_depth() > 0) caps |= AMYCHIP_CAP_RENDER_AHEAD;
+    if(amychip_spi_running()) caps |= AMYCHIP_CAP_SPI;
+    if(amychip_uart_running()) caps |= AMYCHIP_CAP_UART;
+
+    memset(r, 0, AMYCHIP_REGS_SIZE);
+    put_u16(r, AMYCHIP_REG_VERSION, AMYCHIP_PROTOCOL_VERSION);
+    put_u16(r, AMYCHIP_REG_CAPABILITIES, caps);
+    // core 0 only renders; core 1's fill task is busy from the block's input to its output
+    put_u8(r, AMYCHIP_REG_LOAD_CORE0, load_percent(balance.render_us[0], stats.deadline_us));
+    put_u8(r, AMYCHIP_REG_LOAD_CORE1, load_percent(stats.render_us_last, stats.deadline_us));
+    put_u8(r, AMYCHIP_REG_LATENCY, esp_get_latency_profile());
+    put_u8(r, AMYCHIP_REG_SHED_POLICY, esp_get_shed_policy());
+    put_u32(r, AMYCHIP_REG_UNDERRUNS, stats.underruns);
+    put_u16(r, AMYCHIP_REG_QUEUE_USED, ring.used);
+    put_u16(r, AMYCHIP_REG_QUEUE_SIZE, ring.size);
+    put_u32(r, AMYCHIP_REG_QUEUE_DROPS, ring.drops);
+    put_u32(r, AMYCHIP_REG_FREE_PSRAM, heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    put_u16(r, AMYCHIP_REG_ACTIVE_VOICES, balance.active_oscs[0] + balance.active_oscs[1]);
+    put_u8(r, AMYCHIP_REG_RENDER_AHEAD, esp_get_render_ahead());
+    put_u8(r, AMYCHIP_REG_EVENTS, amychip_irq_pending());
+    put_u32(r, AMYCHIP_REG_BLOCKS, stats.blocks);
+    put_u32(r, AMYCHIP_REG_SNAPSHOT, ++snapshots);
+    put_u32(r, AMYCHIP_REG_RX_STRETCHES, rx.stretches);
+    put_u32(r, AMYCHIP_REG_RX_LOST, rx.lost);
+    put_u16(r, AMYCHIP_REG_RX_DISPATCH_US, rx.dispatch_us_last > 0xffff ? 0xffff : rx.dispatch_us_last);
+    put_u16(r, AMYCHIP_REG_RX_DISPATCH_MAX, rx.dispatch_us_max > 0xffff ? 0xffff : rx.dispatch_us_max);
+    put_u32(r, AMYCHIP_REG_CODEC_MERGED, codec.merged);
+    put_u32(r, AMYCHIP_REG_CODEC_DROPPED, codec.dropped);
+    put_u16(r, AMYCHIP_REG_CODEC_PENDING, codec.pending);
+    put_u32(r, AMYCHIP_REG_SAMPLE_RATE, esp_get_sample_rate());
+
+    __atomic_store_n(&regs_current, regs_current ^ 1, __ATOMIC_RELEASE);
+}
+
+size_t amychip_regs_read(uint8_t reg, uint8_t *out, size_t max) {
+    if(reg >= AMYCHIP_REGS_SIZE) return 0;
+    const uint8_t *r = regs[__atomic_load_n(&regs_current, __ATOMIC_ACQUIRE)];
+    size_t len = AMYCHIP_REGS_SIZE - reg;
+    if(len > max) len = max;
+    memcpy(out, r + reg, len);
+    return len;
+}
@@ -0,0 +1,19 @@
+// amychip_regs.h
+// The status registers a host reads back over I2C, see AMYCHIP_REG_* in
+// amychip_protocol.h. amychip_regs_update() builds a fresh snapshot from the
+// stats the audio tasks keep and publishes it with one atomic store, so a read
+// only ever copies a finished snapshot and never touches the audio path.
+
+#ifndef __AMYCHIP_REGS_H__
+#define __AMYCHIP_REGS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Called from one task only, every few ms
+void amychip_regs_update(void);
+
+// Copies up to max bytes of the latest snapshot starting at reg, returns how many
+size_t amychip_regs_read(uint8_t reg, uint8_t *out, size_t max);
+
+#endif
@@ -0,0 +1,64 @@
+// amychip_ring.c
+// Lock-free SPSC message ring, see amychip_ring.h
+
+#include <string.h>
+#include "amychip_ring.h"
+
+// The index a side publishes is stored with release ordering and the other side
+// loads it with acquire, so the bytes it covers are visible before it is.
+#define RING_LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define RING_STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+void amychip_ring_init(amychip_ring_t *ring, uint8_t *buf, uint32_t size) {
+    memset(ring, 0, sizeof(amychip_ring_t));
+    ring->buf = buf;
+    ring->size = size;
+}
+
+static void ring_write(amychip_ring_t *ring, uint32_t at, const uint8_t *src, size_t len) {
+    uint32_t offset = at & (ring->size - 1);
+    size_t first = ring->size - offset;
+    if(first > len) first = len;
+    memcpy(ring->buf + offset, src, first);
+    memcpy(ring->buf, src + first, len - first);
+}
+
+static void ring_read(const amychip_ring_t *ring, uint32_t at, uint8_t *dst, size_t len) {
+    uint32_t offset = at & (ring->size - 1);
+    size_t first = ring->size - offset;
+    if(first > len) first = len;
+    memcpy(dst, ring->buf + offset, first);
+    memcpy(dst + first, ring->buf, len - first);
+}
+
+bool amychip_ring_push(amychip_ring_t *ring, const uint8_t *data, size_t len) {
+    uint32_t head = ring->head;
+    uint32_t used = head - RING_LOAD(&ring->tail);
+    if(len > 0xffff || used + AMYCHIP_RING_HEADER + len > ring->size) {
+        ring->drops++;
+        return false;
+    }
+    uint8_t header[AMYCHIP_RING_HEADER] = { len & 0xff, len >> 8 };
+    ring_write(ring, head, header, AMYCHIP_RING_HEADER);
+    ring_write(ring, head + AMYCHIP_RING_HEADER, data, len);
+    RING_STORE(&ring->head, head + AMYCHIP_RING_HEADER + len);
+    ring->pushed++;
+    used += AMYCHIP_RING_HEADER + len;
+    if(used > ring->high_water) ring->high_water = used;
+    return true;
+}
+
+size_t amychip_ring_pop(amychip_ring_t *ring, uint8_t *out, size_t max) {
+    uint32_t tail = ring->tail;
+    if(RING_LOAD(&ring->head) == tail) return 0;
+    uint8_t header[AMYCHIP_RING_HEADER];
+    ring_read(ring, tail, header, AMYCHIP_RING_HEADER);
+    size_t len = header[0] | (header[1] << 8);
+    ring_read(ring, tail + AMYCHIP_RING_HEADER, out, len < max ? len : max);
+    RING_STORE(&ring->tail, tail + AMYCHIP_RING_HEADER + len);
+    return len;
+}
+
+uint32_t amychip_ring_used(const amychip_ring_t *ring) {
+    return RING_LOAD(&ring->head) - RING_LOAD(&ring->tail);
+}
@@ -0,0 +1,36 @@
+// amychip_ring.h
+// Ring of variable length messages with one consumer. The producer only moves
+// head and the consumer only moves tail, so the two sides never block or lock
+// each other out. Pushes from more than one task have to be serialized by the
+// caller (amychip.c holds command_ring_lock), pops must all come from one task.
+
+#ifndef __AMYCHIP_RING_H__
+#define __AMYCHIP_RING_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t size;            // bytes, a power of two
+    volatile uint32_t head;   // free running, written by the producer
+    volatile uint32_t tail;   // free running, written by the consumer
+    volatile uint32_t pushed; // producer
+    volatile uint32_t drops;  // producer, messages that didn't fit
+    volatile uint32_t high_water; // producer, most bytes ever waiting
+} amychip_ring_t;
+
+// Each message costs its length plus a 2 byte header
+#define AMYCHIP_RING_HEADER 2
+
+void amychip_ring_init(amychip_ring_t *ring, uint8_t *buf, uint32_t size);
+// Producer side. Returns false and counts a drop if the message doesn't fit.
+bool amychip_ring_push(amychip_ring_t *ring, const uint8_t *data, size_t len);
+// Consumer side. Copies the oldest message into out (truncated to max) and
+// returns its length, or returns 0 if the ring is empty.
+size_t amychip_ring_pop(amychip_ring_t *ring, uint8_t *out, size_t max);
+// Bytes waiting, safe from either side
+uint32_t amychip_ring_used(const amychip_ring_t *ring);
+
+#endif
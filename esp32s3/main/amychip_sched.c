@@ -0,0 +1,68 @@
+// amychip_sched.c
+// A binary heap over a fixed pool of message slots, see amychip_sched.h.
+// Times are compared as signed differences, so the clock can wrap.
+
+#include <string.h>
+#include "amychip_sched.h"
+
+void amychip_sched_init(amychip_sched_t *sched) {
+    memset(sched, 0, sizeof(amychip_sched_t));
+    for(int i = 0; i < AMYCHIP_SCHED_SLOTS; i++) sched->free[i] = i;
+}
+
+static int sched_before(const amychip_sched_t *sched, uint8_t a, uint8_t b) {
+    int32_t dt = (int32_t)(sched->slots[a].time - sched->slots[b].time);
+    if(dt != 0) return dt < 0;
+    return (int32_t)(sched->slots[a].seq - sched->slots[b].seq) < 0;
+}
+
+static void sched_swap(amychip_sched_t *sched, int i, int j) {
+    uint8_t t = sched->heap[i];
+    sched->heap[i] = sched->heap[j];
+    sched->heap[j] = t;
+}
+
+int amychip_sched_add(amychip_sched_t *sched, uint32_t time, const uint8_t *message, size_t len) {
+    if(sched->count == AMYCHIP_SCHED_SLOTS || len > AMYCHIP_SCHED_MAX_MESSAGE) {
+        sched->drops++;
+        return 0;
+    }
+    // slots in use are heap[0..count), so the free list is the rest of free[]
+    uint8_t slot = sched->free[sched->count];
+    amychip_sched_entry_t *e = &sched->slots[slot];
+    e->time = time;
+    e->seq = sched->seq++;
+    e->len = len;
+    memcpy(e->message, message, len);
+    int i = sched->count++;
+    sched->heap[i] = slot;
+    while(i > 0 && sched_before(sched, sched->heap[i], sched->heap[(i - 1) / 2])) {
+        sched_swap(sched, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    sched->added++;
+    return 1;
+}
+
+size_t amychip_sched_pop_due(amychip_sched_t *sched, uint32_t before, uint8_t *out, uint32_t *time) {
+    if(sched->count == 0) return 0;
+    uint8_t slot = sched->heap[0];
+    amychip_sched_entry_t *e = &sched->slots[slot];
+    if((int32_t)(e->time - before) >= 0) return 0;
+    size_t len = e->len;
+    memcpy(out, e->message, len);
+    *time = e->time;
+    sched->count--;
+    sched->free[sched->count] = slot;
+    sched->heap[0] = sched->heap[sched->count];
+    int i = 0;
+    while(1) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if(l < sched->count && sched_before(sched, sched->heap[l], sched->heap[m])) m = l;
+        if(r < sched->count && sched_before(sched, sched->heap[r], sched->heap[m])) m = r;
+        if(m == i) break;
+        sched_swap(sched, i, m);
+        i = m;
+    }
+    return len;
+}
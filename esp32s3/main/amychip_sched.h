@@ -0,0 +1,41 @@
+// amychip_sched.h
+// Messages held back until a given time on the chip's sample clock, in time
+// order. Owned by one task (the fill task): it adds them as they come off the
+// message queue and takes out the ones that are due before each block, so
+// times only resolve to the nearest block.
+
+#ifndef __AMYCHIP_SCHED_H__
+#define __AMYCHIP_SCHED_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define AMYCHIP_SCHED_SLOTS 64
+// Timestamped messages are notes and parameter changes; longer ones are refused
+#define AMYCHIP_SCHED_MAX_MESSAGE 120
+
+typedef struct {
+    uint32_t time;   // sample clock
+    uint32_t seq;    // arrival order, for messages with the same time
+    uint16_t len;
+    uint8_t message[AMYCHIP_SCHED_MAX_MESSAGE];
+} amychip_sched_entry_t;
+
+typedef struct {
+    amychip_sched_entry_t slots[AMYCHIP_SCHED_SLOTS];
+    uint8_t heap[AMYCHIP_SCHED_SLOTS];  // slot indices, min-heap on (time, seq)
+    uint8_t free[AMYCHIP_SCHED_SLOTS];  // unused slot indices
+    uint8_t count;
+    uint32_t seq;
+    uint32_t added;
+    uint32_t drops;  // full, or too long
+} amychip_sched_t;
+
+void amychip_sched_init(amychip_sched_t *sched);
+// Returns 0 if it couldn't be held
+int amychip_sched_add(amychip_sched_t *sched, uint32_t time, const uint8_t *message, size_t len);
+// The earliest message due before `before` (wrapping compare), copied to out.
+// Returns its length and time, or 0 if nothing is due.
+size_t amychip_sched_pop_due(amychip_sched_t *sched, uint32_t before, uint8_t *out, uint32_t *time);
+
+#endif
@@ -0,0 +1,94 @@
+// amychip_spi.c
+// SPI slave front end on the ESP-IDF SPI slave driver with DMA.
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/spi_slave.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "amychip_spi.h"
+
+#define SPI_SLAVE_HOST SPI2_HOST
+// Same as the I2C slave task
+#define SPI_SLAVE_TASK_PRIORITY 20
+#define SPI_SLAVE_TASK_STACK_SIZE (4 * 1024)
+
+static const char *TAG = "amychip_spi";
+
+static spi_slave_transaction_t spi_trans[AMYCHIP_SPI_BUFFERS];
+static amychip_spi_receive_t spi_receive = NULL;
+static volatile amychip_spi_stats_t spi_stats;
+static TaskHandle_t spi_task_handle = NULL;
+
+static esp_err_t spi_queue(spi_slave_transaction_t *t) {
+    t->length = AMYCHIP_SPI_MAX_TRANSFER * 8;
+    t->trans_len = 0;
+    return spi_slave_queue_trans(SPI_SLAVE_HOST, t, portMAX_DELAY);
+}
+
+// Takes each finished transaction, dispatches it straight from its DMA buffer
+// and queues the buffer again behind the one the host is clocking into now.
+static void spi_slave_task(void *pv_args) {
+    while(1) {
+        spi_slave_transaction_t *t;
+        if(spi_slave_get_trans_result(SPI_SLAVE_HOST, &t, portMAX_DELAY) != ESP_OK) continue;
+        size_t len = t->trans_len / 8;
+        int64_t start = esp_timer_get_time();
+        if(len > 0) {
+            spi_receive((const uint8_t *)t->rx_buffer, len);
+        } else {
+            spi_stats.empty++;
+        }
+        uint32_t us = (uint32_t)(esp_timer_get_time() - start);
+        spi_stats.transactions++;
+        spi_stats.bytes += len;
+        spi_stats.receive_us += us;
+        if(us > spi_stats.receive_us_max) spi_stats.receive_us_max = us;
+        spi_queue(t);
+    }
+}
+
+esp_err_t amychip_spi_init(int mosi, int miso, int sclk, int cs, amychip_spi_receive_t receive) {
+    spi_bus_config_t bus_cfg = {
+        .mosi_io_num = mosi,
+        .miso_io_num = miso,
+        .sclk_io_num = sclk,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = AMYCHIP_SPI_MAX_TRANSFER,
+    };
+    spi_slave_interface_config_t slave_cfg = {
+        .mode = 0,
+        .spics_io_num = cs,
+        .queue_size = AMYCHIP_SPI_BUFFERS,
+        .flags = 0,
+    };
+    esp_err_t err = spi_slave_initialize(SPI_SLAVE_HOST, &bus_cfg, &slave_cfg, SPI_DMA_CH_AUTO);
+    if(err != ESP_OK) return err;
+    spi_receive = receive;
+    for(int i = 0; i < AMYCHIP_SPI_BUFFERS; i++) {
+        memset(&spi_trans[i], 0, sizeof(spi_slave_transaction_t));
+        // nothing to send back yet, MISO idles
+        spi_trans[i].rx_buffer = heap_caps_malloc(AMYCHIP_SPI_MAX_TRANSFER, MALLOC_CAP_DMA);
+        if(spi_trans[i].rx_buffer == NULL) return ESP_ERR_NO_MEM;
+        err = spi_queue(&spi_trans[i]);
+        if(err != ESP_OK) return err;
+    }
+    if(xTaskCreate(spi_slave_task, "spi_slave_task", SPI_SLAVE_TASK_STACK_SIZE, NULL,
+                   SPI_SLAVE_TASK_PRIORITY, &spi_task_handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "SPI slave on MOSI %d MISO %d SCLK %d CS %d, %d x %d byte transactions",
+             mosi, miso, sclk, cs, AMYCHIP_SPI_BUFFERS, AMYCHIP_SPI_MAX_TRANSFER);
+    return ESP_OK;
+}
+
+int amychip_spi_running(void) {
+    return spi_task_handle != NULL;
+}
+
+void amychip_spi_get_stats(amychip_spi_stats_t *stats) {
+    memcpy(stats, (const void *)&spi_stats, sizeof(amychip_spi_stats_t));
+}
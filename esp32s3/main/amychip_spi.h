@@ -0,0 +1,33 @@
+// amychip_spi.h
+// SPI slave control transport. Each transaction (CS low to CS high) is one
+// write, handed to the same receive path as an I2C write. Two DMA buffers are
+// kept queued with the driver, so the host can clock the next transaction in
+// while the last one is being dispatched, and the CPU only reads each byte
+// once, when it's copied onto the message queue.
+
+#ifndef __AMYCHIP_SPI_H__
+#define __AMYCHIP_SPI_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// The longest transaction; a longer batch carries on with AMYCHIP_CMD_BATCH_MORE
+#define AMYCHIP_SPI_MAX_TRANSFER 4096
+#define AMYCHIP_SPI_BUFFERS 2
+
+typedef void (*amychip_spi_receive_t)(const uint8_t *data, size_t len);
+
+typedef struct {
+    uint32_t transactions;
+    uint32_t bytes;
+    uint32_t receive_us;     // total time dispatching transactions
+    uint32_t receive_us_max;
+    uint32_t empty;          // transactions with no data
+} amychip_spi_stats_t;
+
+esp_err_t amychip_spi_init(int mosi, int miso, int sclk, int cs, amychip_spi_receive_t receive);
+int amychip_spi_running(void);
+void amychip_spi_get_stats(amychip_spi_stats_t *stats);
+
+#endif
@@ -0,0 +1,46 @@
+// amychip_stats.c
+// Lock-free audio pipeline counters, see amychip_stats.h
+
+#include <string.h>
+#include "amychip_stats.h"
+
+volatile amychip_stats_t amychip_stats;
+
+// Sub-millisecond remainders of the wait totals, owned by the same task as the total
+static uint32_t read_wait_us_rem = 0;
+static uint32_t write_wait_us_rem = 0;
+
+void amychip_stats_init(uint32_t deadline_us) {
+    memset((void *)&amychip_stats, 0, sizeof(amychip_stats_t));
+    amychip_stats.deadline_us = deadline_us;
+}
+
+void amychip_stats_block(uint32_t render_us) {
+    uint32_t bin = render_us * 8 / amychip_stats.deadline_us;
+    if(bin >= AMYCHIP_RENDER_HIST_BINS) bin = AMYCHIP_RENDER_HIST_BINS - 1;
+    amychip_stats.render_hist[bin]++;
+    amychip_stats.render_us_last = render_us;
+    if(render_us > amychip_stats.render_us_max) amychip_stats.render_us_max = render_us;
+    amychip_stats.blocks++;
+}
+
+void amychip_stats_read_wait(uint32_t wait_us) {
+    read_wait_us_rem += wait_us;
+    amychip_stats.read_wait_ms += read_wait_us_rem / 1000;
+    read_wait_us_rem %= 1000;
+}
+
+void amychip_stats_write_wait(uint32_t wait_us) {
+    write_wait_us_rem += wait_us;
+    amychip_stats.write_wait_ms += write_wait_us_rem / 1000;
+    write_wait_us_rem %= 1000;
+}
+
+// A plain word by word copy, the writers never wait on a reader
+void amychip_stats_get(amychip_stats_t *stats) {
+    const volatile uint32_t *src = (const volatile uint32_t *)&amychip_stats;
+    uint32_t *dst = (uint32_t *)stats;
+    for(size_t i = 0; i < sizeof(amychip_stats_t) / sizeof(uint32_t); i++) {
+        dst[i] = src[i];
+    }
+}
@@ -0,0 +1,51 @@
+// amychip_stats.h
+// Audio pipeline telemetry. Every field is a 32 bit word with exactly one writer
+// (the fill task, the I2S write task or the I2S interrupt), so the audio path never
+// takes a lock to update them and a reader never sees a torn value. A snapshot
+// taken mid-block may mix this block's counters with the last block's.
+
+#ifndef __AMYCHIP_STATS_H__
+#define __AMYCHIP_STATS_H__
+
+#include <stdint.h>
+
+// Render time histogram, in eighths of the block deadline. The last bin
+// collects everything from (BINS-1)/8 of the deadline up.
+#define AMYCHIP_RENDER_HIST_BINS 16
+
+typedef struct {
+    uint32_t blocks;          // blocks rendered
+    uint32_t underruns;       // blocks the DAC needed before we had them
+    uint32_t short_reads;     // i2s_channel_read returned less than a block
+    uint32_t short_writes;    // i2s_channel_write took less than a block
+    uint32_t deadline_us;     // one block at the sample rate
+    uint32_t render_us_last;  // input ready to block handed to the output
+    uint32_t render_us_max;
+    uint32_t read_wait_ms;    // total time blocked on I2S input
+    uint32_t write_wait_ms;   // total time blocked on I2S output
+    uint32_t shed_blocks;     // blocks that stopped oscillators to make the deadline
+    uint32_t shed_oscs;       // oscillators stopped
+    uint32_t effects_shed_blocks; // blocks rendered with the effects muted
+    uint32_t input_off_blocks; // blocks rendered with audio input capture off
+    uint32_t ascii_messages;  // AMY messages played, and what they cost to send and parse
+    uint32_t ascii_bytes;
+    uint32_t ascii_us;
+    uint32_t binary_messages; // the same for binary event frames
+    uint32_t binary_bytes;
+    uint32_t binary_us;
+    uint32_t wire_errors;     // binary frames that didn't decode
+    uint32_t sched_messages;  // timestamped messages played
+    uint32_t sched_late;      // of those, ones that arrived after their block had gone
+    uint32_t sched_drops;     // ones refused, the schedule was full or they were too long
+    uint32_t render_hist[AMYCHIP_RENDER_HIST_BINS];
+} amychip_stats_t;
+
+extern volatile amychip_stats_t amychip_stats;
+
+void amychip_stats_init(uint32_t deadline_us);
+void amychip_stats_block(uint32_t render_us);
+void amychip_stats_read_wait(uint32_t wait_us);
+void amychip_stats_write_wait(uint32_t wait_us);
+void amychip_stats_get(amychip_stats_t *stats);
+
+#endif
@@ -0,0 +1,119 @@
+// amychip_uart.c
+// UART front end on the ESP-IDF UART driver. The driver's interrupt moves the
+// FIFO into its ring buffer and posts an event; this task drains the ring in
+// as big reads as it has and decodes the COBS stream straight from them.
+
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "driver/uart.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "amychip_cobs.h"
+#include "amychip_uart.h"
+
+// Room for a couple of ms of stream at multi-megabaud while the task is busy
+#define UART_RX_RING_BYTES 8192
+#define UART_READ_BYTES 1024
+#define UART_EVENT_QUEUE_LEN 32
+// Same as the I2C slave task
+#define UART_TASK_PRIORITY 20
+#define UART_TASK_STACK_SIZE (4 * 1024)
+
+static const char *TAG = "amychip_uart";
+
+static int uart_port = -1;
+static QueueHandle_t uart_events = NULL;
+static TaskHandle_t uart_task_handle = NULL;
+static amychip_uart_receive_t uart_receive = NULL;
+static amychip_cobs_t uart_cobs;
+static volatile amychip_uart_stats_t uart_stats;
+
+static void uart_deliver(const uint8_t *frame, size_t len) {
+    int64_t start = esp_timer_get_time();
+    uart_receive(frame, len);
+    uart_stats.receive_us += (uint32_t)(esp_timer_get_time() - start);
+}
+
+static void uart_task(void *pv_args) {
+    static uint8_t data[UART_READ_BYTES];
+    int64_t second_start = esp_timer_get_time();
+    uint32_t second_bytes = uart_stats.bytes;
+    while(1) {
+        uart_event_t event;
+        if(xQueueReceive(uart_events, &event, pdMS_TO_TICKS(1000)) == pdTRUE) {
+            switch(event.type) {
+                case UART_DATA: {
+                    size_t waiting = 0;
+                    uart_get_buffered_data_len(uart_port, &waiting);
+                    while(waiting > 0) {
+                        int n = uart_read_bytes(uart_port, data, waiting < UART_READ_BYTES ? waiting : UART_READ_BYTES, 0);
+                        if(n <= 0) break;
+                        uart_stats.bytes += n;
+                        amychip_cobs_feed(&uart_cobs, data, n, uart_deliver);
+                        waiting -= n;
+                    }
+                    break;
+                }
+                case UART_FIFO_OVF:
+                case UART_BUFFER_FULL:
+                    // bytes are gone, the frame they were in can't be trusted
+                    uart_stats.overflows++;
+                    uart_flush_input(uart_port);
+                    xQueueReset(uart_events);
+                    amychip_cobs_abort(&uart_cobs);
+                    break;
+                case UART_FRAME_ERR:
+                case UART_PARITY_ERR:
+                    uart_stats.line_errors++;
+                    amychip_cobs_abort(&uart_cobs);
+                    break;
+                default:
+                    break;
+            }
+            uart_stats.frames = uart_cobs.frames;
+            uart_stats.frame_errors = uart_cobs.errors;
+        }
+        int64_t now = esp_timer_get_time();
+        if(now - second_start >= 1000000) {
+            uart_stats.bytes_per_s = (uint32_t)((uint64_t)(uart_stats.bytes - second_bytes) * 1000000 / (now - second_start));
+            second_start = now;
+            second_bytes = uart_stats.bytes;
+        }
+    }
+}
+
+esp_err_t amychip_uart_init(int port, int tx, int rx, uint32_t baud, amychip_uart_receive_t receive) {
+    uart_config_t uart_cfg = {
+        .baud_rate = baud,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+    esp_err_t err = uart_driver_install(port, UART_RX_RING_BYTES, 0, UART_EVENT_QUEUE_LEN, &uart_events, 0);
+    if(err != ESP_OK) return err;
+    err = uart_param_config(port, &uart_cfg);
+    if(err != ESP_OK) return err;
+    err = uart_set_pin(port, tx, rx, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    if(err != ESP_OK) return err;
+    uart_port = port;
+    uart_receive = receive;
+    amychip_cobs_init(&uart_cobs);
+    if(xTaskCreate(uart_task, "uart_task", UART_TASK_STACK_SIZE, NULL, UART_TASK_PRIORITY, &uart_task_handle) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "UART%d on TX %d RX %d at %" PRIu32 " baud, COBS framed", port, tx, rx, baud);
+    return ESP_OK;
+}
+
+int amychip_uart_running(void) {
+    return uart_task_handle != NULL;
+}
+
+void amychip_uart_get_stats(amychip_uart_stats_t *stats) {
+    memcpy(stats, (const void *)&uart_stats, sizeof(amychip_uart_stats_t));
+}
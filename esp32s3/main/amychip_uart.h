@@ -0,0 +1,28 @@
+// amychip_uart.h
+// UART control transport. The stream is COBS framed (amychip_cobs.h) and each
+// frame is handed to the same receive path as an I2C write.
+
+#ifndef __AMYCHIP_UART_H__
+#define __AMYCHIP_UART_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+typedef void (*amychip_uart_receive_t)(const uint8_t *data, size_t len);
+
+typedef struct {
+    uint32_t frames;         // delivered
+    uint32_t bytes;          // stream bytes received, framing included
+    uint32_t frame_errors;   // COBS frames dropped: cut short, too long or broken
+    uint32_t line_errors;    // bytes the UART saw with a bad stop or parity bit
+    uint32_t overflows;      // times the driver's buffer filled and bytes were lost
+    uint32_t receive_us;     // total time dispatching frames
+    uint32_t bytes_per_s;    // stream bytes over the last second
+} amychip_uart_stats_t;
+
+esp_err_t amychip_uart_init(int port, int tx, int rx, uint32_t baud, amychip_uart_receive_t receive);
+int amychip_uart_running(void);
+void amychip_uart_get_stats(amychip_uart_stats_t *stats);
+
+#endif
@@ -0,0 +1,54 @@
+// amychip_upload.c
+// Chunked sample upload, see amychip_upload.h.
+
+#include <string.h>
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "amychip_protocol.h"
+#include "amychip_upload.h"
+
+void amychip_upload_init(amychip_upload_t *upload) {
+    memset(upload, 0, sizeof(amychip_upload_t));
+    upload->state = AMYCHIP_UPLOAD_IDLE;
+}
+
+void amychip_upload_start(amychip_upload_t *upload, uint16_t patch, uint8_t *buf, uint32_t size) {
+    amychip_upload_init(upload);
+    upload->buf = buf;
+    upload->size = size;
+    upload->patch = patch;
+    upload->state = AMYCHIP_UPLOAD_RECEIVING;
+    upload->start_us = esp_timer_get_time();
+}
+
+void amychip_upload_fail(amychip_upload_t *upload, uint16_t patch) {
+    amychip_upload_init(upload);
+    upload->patch = patch;
+    upload->state = AMYCHIP_UPLOAD_FAILED;
+}
+
+int amychip_upload_chunk(amychip_upload_t *upload, uint32_t offset, uint32_t crc, const uint8_t *data, size_t len) {
+    if(upload->state != AMYCHIP_UPLOAD_RECEIVING) return AMYCHIP_UPLOAD_CHUNK_IDLE;
+    if(offset > upload->received || len > upload->size - offset) {
+        upload->bad_offset++;
+        return AMYCHIP_UPLOAD_CHUNK_BAD_OFFSET;
+    }
+    if(esp_rom_crc32_le(0, data, len) != crc) {
+        upload->bad_crc++;
+        return AMYCHIP_UPLOAD_CHUNK_BAD_CRC;
+    }
+    memcpy(upload->buf + offset, data, len);
+    upload->chunks++;
+    if(offset + len > upload->received) upload->received = offset + len;
+    if(upload->received < upload->size) return AMYCHIP_UPLOAD_CHUNK_OK;
+    upload->state = AMYCHIP_UPLOAD_DONE;
+    upload->done_us = esp_timer_get_time();
+    return AMYCHIP_UPLOAD_CHUNK_DONE;
+}
+
+uint32_t amychip_upload_rate(const amychip_upload_t *upload) {
+    if(upload->start_us == 0) return 0;
+    int64_t end = upload->state == AMYCHIP_UPLOAD_DONE ? upload->done_us : esp_timer_get_time();
+    if(end <= upload->start_us) return 0;
+    return (uint32_t)((int64_t)upload->received * 1000000 / (end - upload->start_us));
+}
@@ -0,0 +1,43 @@
+// amychip_upload.h
+// Binary sample upload: raw PCM chunks copied straight into a buffer the size
+// of the whole sample (AMY's memorypcm, in PSRAM), each checked against its
+// own CRC. Chunks may come in any order as long as none starts past what has
+// arrived with no gaps, so a host that lost its place reads back `received`
+// and carries on from there. Not thread safe, the caller holds a lock.
+
+#ifndef __AMYCHIP_UPLOAD_H__
+#define __AMYCHIP_UPLOAD_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// What a chunk did, see amychip_upload_chunk
+#define AMYCHIP_UPLOAD_CHUNK_OK         0
+#define AMYCHIP_UPLOAD_CHUNK_DONE       1  // that was the last missing chunk
+#define AMYCHIP_UPLOAD_CHUNK_BAD_CRC    2
+#define AMYCHIP_UPLOAD_CHUNK_BAD_OFFSET 3  // starts past received or runs past the end
+#define AMYCHIP_UPLOAD_CHUNK_IDLE       4  // no upload in progress
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t size;        // bytes expected
+    uint32_t received;    // bytes in from the start with no gaps
+    uint16_t patch;
+    uint8_t state;        // AMYCHIP_UPLOAD_*
+    uint32_t chunks;      // taken
+    uint32_t bad_crc;     // refused
+    uint32_t bad_offset;
+    int64_t start_us;
+    int64_t done_us;
+} amychip_upload_t;
+
+void amychip_upload_init(amychip_upload_t *upload);
+void amychip_upload_start(amychip_upload_t *upload, uint16_t patch, uint8_t *buf, uint32_t size);
+// The buffer couldn't be had
+void amychip_upload_fail(amychip_upload_t *upload, uint16_t patch);
+// data goes at offset if its CRC-32 matches crc. Returns AMYCHIP_UPLOAD_CHUNK_*
+int amychip_upload_chunk(amychip_upload_t *upload, uint32_t offset, uint32_t crc, const uint8_t *data, size_t len);
+// Bytes per second from start to done, or to now if it's still going
+uint32_t amychip_upload_rate(const amychip_upload_t *upload);
+
+#endif
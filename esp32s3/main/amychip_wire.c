@@ -0,0 +1,106 @@
+// amychip_wire.c
+// Binary AMY event frames, see amychip_wire.h
+
+#include <string.h>
+#include "amychip_wire.h"
+#include "amychip_protocol.h"
+
+enum { WIRE_U8, WIRE_U16, WIRE_U32, WIRE_Q12, WIRE_F32 };
+
+static const uint8_t wire_type[AMYCHIP_FIELDS] = {
+    [AMYCHIP_FIELD_TIME]        = WIRE_U32,
+    [AMYCHIP_FIELD_WAVE]        = WIRE_U8,
+    [AMYCHIP_FIELD_PATCH]       = WIRE_U16,
+    [AMYCHIP_FIELD_MIDI_NOTE]   = WIRE_U8,
+    [AMYCHIP_FIELD_VELOCITY]    = WIRE_Q12,
+    [AMYCHIP_FIELD_AMP]         = WIRE_Q12,
+    [AMYCHIP_FIELD_FREQ]        = WIRE_F32,
+    [AMYCHIP_FIELD_DUTY]        = WIRE_Q12,
+    [AMYCHIP_FIELD_PAN]         = WIRE_Q12,
+    [AMYCHIP_FIELD_FILTER_FREQ] = WIRE_F32,
+    [AMYCHIP_FIELD_RESONANCE]   = WIRE_Q12,
+    [AMYCHIP_FIELD_FILTER_TYPE] = WIRE_U8,
+    [AMYCHIP_FIELD_FEEDBACK]    = WIRE_Q12,
+    [AMYCHIP_FIELD_VOLUME]      = WIRE_Q12,
+    [AMYCHIP_FIELD_PITCH_BEND]  = WIRE_F32,
+    [AMYCHIP_FIELD_LOAD_PATCH]  = WIRE_U16,
+};
+
+static const uint8_t wire_width[] = { [WIRE_U8] = 1, [WIRE_U16] = 2, [WIRE_U32] = 4, [WIRE_Q12] = 2, [WIRE_F32] = 4 };
+
+static uint32_t wire_get(const uint8_t *p, uint8_t width) {
+    uint32_t v = 0;
+    for(uint8_t i = 0; i < width; i++) v |= (uint32_t)p[i] << (8 * i);
+    return v;
+}
+
+static void wire_put(uint8_t *p, uint8_t width, uint32_t v) {
+    for(uint8_t i = 0; i < width; i++) p[i] = (v >> (8 * i)) & 0xff;
+}
+
+bool amychip_wire_decode(const uint8_t *frame, size_t len, amy_event *e) {
+    if(len < AMYCHIP_WIRE_HEADER || frame[0] != AMYCHIP_CMD_EVENT) return false;
+    *e = amy_default_event();
+    e->osc = frame[1] | (frame[2] << 8);
+    size_t at = AMYCHIP_WIRE_HEADER;
+    while(at < len) {
+        if(frame[at] >= AMYCHIP_FIELDS) return false;
+        uint8_t field = frame[at++];
+        uint8_t type = wire_type[field];
+        uint8_t width = wire_width[type];
+        if(at + width > len) return false;
+        uint32_t raw = wire_get(frame + at, width);
+        at += width;
+        float f;
+        if(type == WIRE_F32) memcpy(&f, &raw, sizeof(f));
+        else if(type == WIRE_Q12) f = (float)raw / AMYCHIP_Q12_ONE;
+        else f = (float)raw;
+        switch(field) {
+            case AMYCHIP_FIELD_TIME:        e->time = raw; break;
+            case AMYCHIP_FIELD_WAVE:        e->wave = raw; break;
+            case AMYCHIP_FIELD_PATCH:       e->patch = raw; break;
+            case AMYCHIP_FIELD_MIDI_NOTE:   e->midi_note = f; break;
+            case AMYCHIP_FIELD_VELOCITY:    e->velocity = f; break;
+            case AMYCHIP_FIELD_AMP:         e->amp_coefs[COEF_CONST] = f; break;
+            case AMYCHIP_FIELD_FREQ:        e->freq_coefs[COEF_CONST] = f; break;
+            case AMYCHIP_FIELD_DUTY:        e->duty_coefs[COEF_CONST] = f; break;
+            case AMYCHIP_FIELD_PAN:         e->pan_coefs[COEF_CONST] = f; break;
+            case AMYCHIP_FIELD_FILTER_FREQ: e->filter_freq_coefs[COEF_CONST] = f; break;
+            case AMYCHIP_FIELD_RESONANCE:   e->resonance = f; break;
+            case AMYCHIP_FIELD_FILTER_TYPE: e->filter_type = raw; break;
+            case AMYCHIP_FIELD_FEEDBACK:    e->feedback = f; break;
+            case AMYCHIP_FIELD_VOLUME:      e->volume = f; break;
+            case AMYCHIP_FIELD_PITCH_BEND:  e->pitch_bend = f; break;
+            case AMYCHIP_FIELD_LOAD_PATCH:  e->load_patch = raw; break;
+        }
+    }
+    return true;
+}
+
+size_t amychip_wire_begin(uint8_t *frame, size_t max, uint16_t osc) {
+    if(max < AMYCHIP_WIRE_HEADER) return 0;
+    frame[0] = AMYCHIP_CMD_EVENT;
+    frame[1] = osc & 0xff;
+    frame[2] = osc >> 8;
+    return AMYCHIP_WIRE_HEADER;
+}
+
+size_t amychip_wire_add(uint8_t *frame, size_t len, size_t max, uint8_t field, double value) {
+    if(field >= AMYCHIP_FIELDS) return 0;
+    uint8_t type = wire_type[field];
+    uint8_t width = wire_width[type];
+    if(len + 1 + width > max) return 0;
+    uint32_t raw;
+    if(type == WIRE_F32) {
+        float f = (float)value;
+        memcpy(&raw, &f, sizeof(raw));
+    } else if(type == WIRE_Q12) {
+        double q = value * AMYCHIP_Q12_ONE + 0.5;
+        raw = q < 0 ? 0 : (q > 0xffff ? 0xffff : (uint32_t)q);
+    } else {
+        raw = (uint32_t)value;
+    }
+    frame[len] = field;
+    wire_put(frame + len + 1, width, raw);
+    return len + 1 + width;
+}
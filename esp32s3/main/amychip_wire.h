@@ -0,0 +1,49 @@
+// amychip_wire.h
+// Binary AMY events: the same fields as an ASCII AMY message, packed so they
+// take fewer bytes on the bus and go straight into an amy_event with no text parsing.
+//
+//   [AMYCHIP_CMD_EVENT] [osc lo] [osc hi] then [field] [value] pairs to the end
+//
+// Values are little endian and as wide as their field's type, see amychip_wire.c.
+
+#ifndef __AMYCHIP_WIRE_H__
+#define __AMYCHIP_WIRE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "amy.h"
+
+#define AMYCHIP_WIRE_HEADER 3
+
+// Fields, with the ASCII AMY parameter each one stands for
+#define AMYCHIP_FIELD_TIME          0   // t, u32 ms
+#define AMYCHIP_FIELD_WAVE          1   // w, u8
+#define AMYCHIP_FIELD_PATCH         2   // p, u16
+#define AMYCHIP_FIELD_MIDI_NOTE     3   // n, u8
+#define AMYCHIP_FIELD_VELOCITY      4   // l, q12
+#define AMYCHIP_FIELD_AMP           5   // a, q12, the constant coefficient
+#define AMYCHIP_FIELD_FREQ          6   // f, f32, the constant coefficient
+#define AMYCHIP_FIELD_DUTY          7   // d, q12, the constant coefficient
+#define AMYCHIP_FIELD_PAN           8   // Q, q12, the constant coefficient
+#define AMYCHIP_FIELD_FILTER_FREQ   9   // F, f32, the constant coefficient
+#define AMYCHIP_FIELD_RESONANCE     10  // R, q12
+#define AMYCHIP_FIELD_FILTER_TYPE   11  // G, u8
+#define AMYCHIP_FIELD_FEEDBACK      12  // b, q12
+#define AMYCHIP_FIELD_VOLUME        13  // V, q12
+#define AMYCHIP_FIELD_PITCH_BEND    14  // s, f32
+#define AMYCHIP_FIELD_LOAD_PATCH    15  // K, u16
+#define AMYCHIP_FIELDS              16
+
+// q12 values are unsigned 4.12 fixed point, 0 to just under 16 in steps of 1/4096
+#define AMYCHIP_Q12_ONE 4096
+
+// Fill e (starting from amy_default_event()) from a binary event frame.
+// Returns false if the frame is malformed or has an unknown field.
+bool amychip_wire_decode(const uint8_t *frame, size_t len, amy_event *e);
+
+// Build a frame for the host side. Returns the bytes written, 0 if it won't fit.
+size_t amychip_wire_begin(uint8_t *frame, size_t max, uint16_t osc);
+size_t amychip_wire_add(uint8_t *frame, size_t len, size_t max, uint8_t field, double value);
+
+#endif
@@ -48,7 +48,13 @@
 
 const char* TAG = "i2c_slave";
 
-#define I2C_SLAVE_USE_RX_QUEUE 0 // 1: Queue, 0: RingBuffer
+// 1: the ISR copies the FIFO straight into one of I2C_SLAVE_RX_SLOTS message
+// buffers and hands each one to the task with a notification at the STOP.
+// 0: FIFO -> ring buffer -> event queue -> task, the old path, to compare against.
+#ifndef I2C_SLAVE_FAST_RX
+#define I2C_SLAVE_FAST_RX 1
+#endif
+#define I2C_SLAVE_RX_SLOTS 4 // a power of two
 
 #if SOC_I2C_NUM > 1
 #define I2C_SCL_IDX(p)  ((p==0)?I2CEXT0_SCL_OUT_IDX:((p==1)?I2CEXT1_SCL_OUT_IDX:0))
@@ -85,6 +91,15 @@ enum {
 #define I2C_SCLK_XTAL SOC_MOD_CLK_XTAL
 #endif
 
+// One write, or the write half of a write-then-read, on its way to the task
+typedef struct {
+    uint8_t * data;     // rx_buf_len bytes plus room for a terminator
+    uint32_t len;
+    uint8_t event;      // I2C_SLAVE_EVT_RX, or I2C_SLAVE_EVT_TX for a read request
+    bool stop;
+    int64_t stop_us;    // when the ISR handed it over
+} i2c_slave_rx_slot_t;
+
 typedef struct i2c_slave_struct_t {
     i2c_dev_t * dev;
     uint8_t num;
@@ -95,26 +110,42 @@ typedef struct i2c_slave_struct_t {
     void * arg;
     intr_handle_t intr_handle;
     TaskHandle_t task_handle;
-    QueueHandle_t event_queue;
-#if I2C_SLAVE_USE_RX_QUEUE
-    QueueHandle_t rx_queue;
-#else
-    RingbufHandle_t rx_ring_buf;
-#endif
-    QueueHandle_t tx_queue;
+    QueueHandle_t event_queue;  // !I2C_SLAVE_FAST_RX
+    RingbufHandle_t rx_ring_buf;  // !I2C_SLAVE_FAST_RX
+    uint8_t * tx_buf;
     uint32_t rx_data_count;
 #if !CONFIG_DISABLE_HAL_LOCKS
     SemaphoreHandle_t lock;
 #endif
+    uint8_t * rx_buf;   // !I2C_SLAVE_FAST_RX: one whole transaction, rx_len bytes plus room for a terminator
+    size_t rx_buf_len;
+    // TX ring: i2cSlaveWrite copies into it in bulk and the ISR copies out of it
+    // into the FIFO in one pass. head only moves in i2cSlaveWrite, tail in the ISR
+    // or, to drop what's queued, under tx_lock.
+    uint32_t tx_size;   // a power of two
+    volatile uint32_t tx_head;
+    volatile uint32_t tx_tail;
+    portMUX_TYPE tx_lock;
+    // RX backpressure: with no room for the FIFO the ISR leaves it full, so the
+    // hardware holds SCL, until the task has made room (i2c_slave_rx_resume).
+    // Room is a free slot, or on the old path rx_pending bytes in the ring.
+    uint32_t rx_pending;
+    bool rx_stalled;
+    portMUX_TYPE rx_lock;
+    // Fast path: the ISR fills the slot at rx_head and hands it over by moving
+    // rx_head on, the task gives it back by moving rx_tail
+    i2c_slave_rx_slot_t rx_slots[I2C_SLAVE_RX_SLOTS];
+    volatile uint32_t rx_head;
+    volatile uint32_t rx_tail;
+    bool rx_read_pending;   // a read request that found no free slot
+    i2c_slave_rx_stats_t rx_stats;
 } i2c_slave_struct_t;
 
-typedef union {
-    struct {
-        uint32_t event : 2;
-        uint32_t stop : 1;
-        uint32_t param : 29;
-    };
-    uint32_t val;
+typedef struct {
+    uint32_t event : 2;
+    uint32_t stop : 1;
+    uint32_t param : 29;
+    int64_t stop_us;    // when the ISR sent it
 } i2c_slave_queue_event_t;
 
 static i2c_slave_struct_t _i2c_bus_array[SOC_I2C_NUM] = {
@@ -211,10 +242,17 @@ static bool i2c_slave_check_line_state(int8_t sda, int8_t scl);
 static bool i2c_slave_attach_gpio(i2c_slave_struct_t * i2c, int8_t sda, int8_t scl);
 static bool i2c_slave_detach_gpio(i2c_slave_struct_t * i2c);
 static bool i2c_slave_set_frequency(i2c_slave_struct_t * i2c, uint32_t clk_speed);
+#if !I2C_SLAVE_FAST_RX
 static bool i2c_slave_send_event(i2c_slave_struct_t * i2c, i2c_slave_queue_event_t* event);
+#endif
 static bool i2c_slave_handle_tx_fifo_empty(i2c_slave_struct_t * i2c);
-static bool i2c_slave_handle_rx_fifo_full(i2c_slave_struct_t * i2c, uint32_t len);
+static bool i2c_slave_handle_rx_fifo_full(i2c_slave_struct_t * i2c, uint32_t len, bool can_stall);
+static bool i2c_slave_rx_finish(i2c_slave_struct_t * i2c, uint8_t event, bool stop);
+static bool i2c_slave_rx_read_request(i2c_slave_struct_t * i2c);
+static void i2c_slave_rx_resume(i2c_slave_struct_t * i2c);
+#if !I2C_SLAVE_FAST_RX
 static size_t i2c_slave_read_rx(i2c_slave_struct_t * i2c, uint8_t * data, size_t len);
+#endif
 static void i2c_slave_isr_handler(void* arg);
 static void i2c_slave_task(void *pv_args);
 
@@ -286,13 +324,19 @@ esp_err_t i2cSlaveInit(uint8_t num, int sda, int scl, uint16_t slaveID, uint32_t
     I2C_SLAVE_MUTEX_LOCK();
     i2c_slave_free_resources(i2c);
 
-#if I2C_SLAVE_USE_RX_QUEUE
-    i2c->rx_queue = xQueueCreate(rx_len, sizeof(uint8_t));
-    if (i2c->rx_queue == NULL) {
-        ESP_LOGE(TAG, "RX queue create failed");
-        ret = ESP_ERR_NO_MEM;
-        goto fail;
+#if I2C_SLAVE_FAST_RX
+    for (int i = 0; i < I2C_SLAVE_RX_SLOTS; i++) {
+        i2c->rx_slots[i].data = (uint8_t *)malloc(rx_len + 1);
+        i2c->rx_slots[i].len = 0;
+        if (i2c->rx_slots[i].data == NULL) {
+            ESP_LOGE(TAG, "RX slot alloc failed");
+            ret = ESP_ERR_NO_MEM;
+            goto fail;
+        }
     }
+    i2c->rx_head = 0;
+    i2c->rx_tail = 0;
+    i2c->rx_read_pending = false;
 #else
     i2c->rx_ring_buf = xRingbufferCreate(rx_len, RINGBUF_TYPE_BYTEBUF);
     if (i2c->rx_ring_buf == NULL) {
@@ -300,21 +344,42 @@ esp_err_t i2cSlaveInit(uint8_t num, int sda, int scl, uint16_t slaveID, uint32_t
         ret = ESP_ERR_NO_MEM;
         goto fail;
     }
-#endif
 
-    i2c->tx_queue = xQueueCreate(tx_len, sizeof(uint8_t));
-    if (i2c->tx_queue == NULL) {
-        ESP_LOGE(TAG, "TX queue create failed");
+    i2c->rx_buf = (uint8_t *)malloc(rx_len + 1);
+    if (i2c->rx_buf == NULL) {
+        ESP_LOGE(TAG, "RX buffer alloc failed");
         ret = ESP_ERR_NO_MEM;
         goto fail;
     }
+#endif
+    i2c->rx_buf_len = rx_len;
+    memset(&i2c->rx_stats, 0, sizeof(i2c->rx_stats));
 
+    i2c->tx_size = 1;
+    while (i2c->tx_size < tx_len) {
+        i2c->tx_size <<= 1;
+    }
+    i2c->tx_buf = (uint8_t *)malloc(i2c->tx_size);
+    if (i2c->tx_buf == NULL) {
+        ESP_LOGE(TAG, "TX ring alloc failed");
+        ret = ESP_ERR_NO_MEM;
+        goto fail;
+    }
+    i2c->tx_head = 0;
+    i2c->tx_tail = 0;
+    portMUX_INITIALIZE(&i2c->tx_lock);
+    i2c->rx_pending = 0;
+    i2c->rx_stalled = false;
+    portMUX_INITIALIZE(&i2c->rx_lock);
+
+#if !I2C_SLAVE_FAST_RX
     i2c->event_queue = xQueueCreate(16, sizeof(i2c_slave_queue_event_t));
     if (i2c->event_queue == NULL) {
         ESP_LOGE(TAG, "Event queue create failed");
         ret = ESP_ERR_NO_MEM;
         goto fail;
     }
+#endif
 
     xTaskCreate(i2c_slave_task, "i2c_slave_task", 8192, i2c, 20, &i2c->task_handle);
     if(i2c->task_handle == NULL){
@@ -408,6 +473,67 @@ esp_err_t i2cSlaveDeinit(uint8_t num){
     return ESP_OK;
 }
 
+// Drop whatever is queued to send, from a task or the ISR
+static void i2c_slave_tx_reset(i2c_slave_struct_t * i2c)
+{
+    portENTER_CRITICAL_SAFE(&i2c->tx_lock);
+    i2c->tx_tail = i2c->tx_head;
+    portEXIT_CRITICAL_SAFE(&i2c->tx_lock);
+}
+
+// Copy as much of buf as fits into the TX ring, returns the bytes queued
+static size_t i2c_slave_tx_push(i2c_slave_struct_t * i2c, const uint8_t *buf, size_t len)
+{
+    uint32_t head = i2c->tx_head;
+    uint32_t space = i2c->tx_size - (head - __atomic_load_n(&i2c->tx_tail, __ATOMIC_ACQUIRE));
+    if(len > space){
+        len = space;
+    }
+    uint32_t offset = head & (i2c->tx_size - 1);
+    size_t first = i2c->tx_size - offset;
+    if(first > len){
+        first = len;
+    }
+    memcpy(i2c->tx_buf + offset, buf, first);
+    memcpy(i2c->tx_buf, buf + first, len - first);
+    __atomic_store_n(&i2c->tx_head, head + len, __ATOMIC_RELEASE);
+    return len;
+}
+
+// ISR: move up to space bytes from the TX ring into the FIFO, at most two
+// contiguous writes. Returns the bytes moved.
+static uint32_t i2c_slave_tx_fill_fifo(i2c_slave_struct_t * i2c, uint32_t space)
+{
+    portENTER_CRITICAL_SAFE(&i2c->tx_lock);
+    uint32_t tail = i2c->tx_tail;
+    uint32_t queued = __atomic_load_n(&i2c->tx_head, __ATOMIC_ACQUIRE) - tail;
+    if(space > queued){
+        space = queued;
+    }
+    uint32_t offset = tail & (i2c->tx_size - 1);
+    uint32_t first = i2c->tx_size - offset;
+    if(first > space){
+        first = space;
+    }
+    if(first){
+        i2c_ll_write_txfifo(i2c->dev, i2c->tx_buf + offset, first);
+    }
+    if(space > first){
+        i2c_ll_write_txfifo(i2c->dev, i2c->tx_buf, space - first);
+    }
+    i2c->tx_tail = tail + space;
+    portEXIT_CRITICAL_SAFE(&i2c->tx_lock);
+    return space;
+}
+
+esp_err_t i2cSlaveGetRxStats(uint8_t num, i2c_slave_rx_stats_t *stats) {
+    if(num >= SOC_I2C_NUM){
+        return ESP_ERR_INVALID_ARG;
+    }
+    *stats = _i2c_bus_array[num].rx_stats;
+    return ESP_OK;
+}
+
 size_t i2cSlaveWrite(uint8_t num, const uint8_t *buf, uint32_t len, uint32_t timeout_ms) {
     if(num >= SOC_I2C_NUM){
         ESP_LOGE(TAG, "Invalid port num: %u", num);
@@ -421,7 +547,7 @@ size_t i2cSlaveWrite(uint8_t num, const uint8_t *buf, uint32_t len, uint32_t tim
         return ESP_ERR_NO_MEM;
     }
 #endif
-    if(!i2c->tx_queue){
+    if(!i2c->tx_buf){
         return 0;
     }
     I2C_SLAVE_MUTEX_LOCK();
@@ -451,22 +577,12 @@ size_t i2cSlaveWrite(uint8_t num, const uint8_t *buf, uint32_t len, uint32_t tim
         i2c_ll_write_txfifo(i2c->dev, (uint8_t*)buf, to_fifo);
         buf += to_fifo;
         len -= to_fifo;
-        //reset tx_queue
-        xQueueReset(i2c->tx_queue);
-        //write the rest of the bytes to the queue
+        //reset tx ring
+        i2c_slave_tx_reset(i2c);
+        //copy the rest of the bytes to the ring
         if(len){
-            to_queue = uxQueueSpacesAvailable(i2c->tx_queue);
-            if(len < to_queue){
-                to_queue = len;
-            }
-            for (size_t i = 0; i < to_queue; i++) {
-                if (xQueueSend(i2c->tx_queue, &buf[i], timeout_ms / portTICK_PERIOD_MS) != pdTRUE) {
-                    xQueueReset(i2c->tx_queue);
-                    to_queue = 0;
-                    break;
-                }
-            }
-            //no need to enable TX_EMPTY if tx_queue is empty
+            to_queue = i2c_slave_tx_push(i2c, buf, len);
+            //no need to enable TX_EMPTY if the ring is empty
             if(to_queue){
                 i2c_ll_slave_enable_tx_it(i2c->dev);
             }
@@ -496,21 +612,29 @@ static void i2c_slave_free_resources(i2c_slave_struct_t * i2c){
         i2c->task_handle = NULL;
     }
 
-#if I2C_SLAVE_USE_RX_QUEUE
-    if (i2c->rx_queue) {
-        vQueueDelete(i2c->rx_queue);
-        i2c->rx_queue = NULL;
-    }
-#else
     if (i2c->rx_ring_buf) {
         vRingbufferDelete(i2c->rx_ring_buf);
         i2c->rx_ring_buf = NULL;
     }
-#endif
 
-    if (i2c->tx_queue) {
-        vQueueDelete(i2c->tx_queue);
-        i2c->tx_queue = NULL;
+    for (int i = 0; i < I2C_SLAVE_RX_SLOTS; i++) {
+        if (i2c->rx_slots[i].data) {
+            free(i2c->rx_slots[i].data);
+            i2c->rx_slots[i].data = NULL;
+        }
+    }
+
+    if (i2c->rx_buf) {
+        free(i2c->rx_buf);
+        i2c->rx_buf = NULL;
+        i2c->rx_buf_len = 0;
+    }
+
+    if (i2c->tx_buf) {
+        free(i2c->tx_buf);
+        i2c->tx_buf = NULL;
+        i2c->tx_head = 0;
+        i2c->tx_tail = 0;
     }
 
     if (i2c->event_queue) {
@@ -666,91 +790,256 @@ static bool i2c_slave_detach_gpio(i2c_slave_struct_t * i2c)
     return true;
 }
 
+#if !I2C_SLAVE_FAST_RX
 static bool i2c_slave_send_event(i2c_slave_struct_t * i2c, i2c_slave_queue_event_t* event)
 {
-    bool pxHigherPriorityTaskWoken = false;
+    BaseType_t pxHigherPriorityTaskWoken = pdFALSE;
     if(i2c->event_queue) {
-        if(xQueueSendFromISR(i2c->event_queue, event, (BaseType_t * const)&pxHigherPriorityTaskWoken) != pdTRUE){
+        if(xQueueSendFromISR(i2c->event_queue, event, &pxHigherPriorityTaskWoken) != pdTRUE){
             //ESP_LOGE(TAG, "event_queue_full");
         }
     }
-    return pxHigherPriorityTaskWoken;
+    return pxHigherPriorityTaskWoken == pdTRUE;
 }
+#endif
 
 static bool i2c_slave_handle_tx_fifo_empty(i2c_slave_struct_t * i2c)
 {
     bool pxHigherPriorityTaskWoken = false;
-    uint32_t d = 0, moveCnt = 0;
+    uint32_t moveCnt = 0;
 #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
     i2c_ll_get_txfifo_len(i2c->dev, &moveCnt);
 #else
     moveCnt = i2c_ll_get_txfifo_len(i2c->dev);
 #endif
-    while (moveCnt > 0) { // read tx queue until Fifo is full or queue is empty
-        if(xQueueReceiveFromISR(i2c->tx_queue, &d, (BaseType_t * const)&pxHigherPriorityTaskWoken) == pdTRUE){
-            i2c_ll_write_txfifo(i2c->dev, (uint8_t*)&d, 1);
-            moveCnt--;
-        } else {
-            if(i2c->request_callback) {
-                // the data is not enough to fill the fifo, request more data
+    // fill the FIFO from the tx ring in one go
+    if(moveCnt > 0 && i2c_slave_tx_fill_fifo(i2c, moveCnt) < moveCnt) {
+        if(i2c->request_callback) {
+            // the data is not enough to fill the fifo, request more data
 #ifdef DEBUG_MODE
-                gpio_set_level(DEBUG_IO2, 1);
+            gpio_set_level(DEBUG_IO2, 1);
 #endif
-                i2c->request_callback(i2c->num, NULL, 0, i2c->arg);
+            i2c->request_callback(i2c->num, NULL, 0, i2c->arg);
 #ifdef DEBUG_MODE
-                gpio_set_level(DEBUG_IO2, 0);
+            gpio_set_level(DEBUG_IO2, 0);
 #endif
-            }
-            uint32_t txfifo_len = 0;
+        }
+        uint32_t txfifo_len = 0;
 #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
-            i2c_ll_get_txfifo_len(i2c->dev, &txfifo_len);
+        i2c_ll_get_txfifo_len(i2c->dev, &txfifo_len);
 #else
-            txfifo_len = i2c_ll_get_txfifo_len(i2c->dev);
+        txfifo_len = i2c_ll_get_txfifo_len(i2c->dev);
 #endif
-            if (SOC_I2C_FIFO_LEN == txfifo_len) {
-                // no more data to send, disable TX_EMPTY interrupt
-                i2c_ll_slave_disable_tx_it(i2c->dev);
-            }
-            break;
+        if (SOC_I2C_FIFO_LEN == txfifo_len) {
+            // no more data to send, disable TX_EMPTY interrupt
+            i2c_ll_slave_disable_tx_it(i2c->dev);
         }
     }
     return pxHigherPriorityTaskWoken;
 }
 
-static bool i2c_slave_handle_rx_fifo_full(i2c_slave_struct_t * i2c, uint32_t len)
+static uint32_t i2c_slave_rxfifo_cnt(i2c_slave_struct_t * i2c)
+{
+    uint32_t len = 0;
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+    i2c_ll_get_rxfifo_cnt(i2c->dev, &len);
+#else
+    len = i2c_ll_get_rxfifo_cnt(i2c->dev);
+#endif
+    return len;
+}
+
+// Read len bytes out of the FIFO into nowhere
+static void i2c_slave_rx_discard(i2c_slave_struct_t * i2c, uint32_t len)
+{
+    uint8_t data[SOC_I2C_FIFO_LEN];
+    i2c_ll_read_rxfifo(i2c->dev, data, len);
+    i2c->rx_stats.lost += len;
+}
+
+// The rest of the RX path runs in the ISR, or in the task with rx_lock held
+
+#if I2C_SLAVE_FAST_RX
+static bool i2c_slave_rx_room(i2c_slave_struct_t * i2c, uint32_t len)
 {
-#if I2C_SLAVE_USE_RX_QUEUE
-    uint32_t d = 0;
+    return i2c->rx_head - __atomic_load_n(&i2c->rx_tail, __ATOMIC_ACQUIRE) < I2C_SLAVE_RX_SLOTS;
+}
+
+static i2c_slave_rx_slot_t * i2c_slave_rx_slot(i2c_slave_struct_t * i2c)
+{
+    return &i2c->rx_slots[i2c->rx_head & (I2C_SLAVE_RX_SLOTS - 1)];
+}
+
+// FIFO straight into the slot at rx_head, what doesn't fit in it is lost
+static bool i2c_slave_rx_store(i2c_slave_struct_t * i2c, uint32_t len, bool room)
+{
+    if(!room){
+        i2c_slave_rx_discard(i2c, len);
+        return false;
+    }
+    i2c_slave_rx_slot_t * slot = i2c_slave_rx_slot(i2c);
+    uint32_t fit = i2c->rx_buf_len - slot->len;
+    if(fit > len){
+        fit = len;
+    }
+    i2c_ll_read_rxfifo(i2c->dev, slot->data + slot->len, fit);
+    slot->len += fit;
+    if(len > fit){
+        i2c_slave_rx_discard(i2c, len - fit);
+    }
+    return false;
+}
+
+// Hand the slot at rx_head to the task
+static bool i2c_slave_rx_publish(i2c_slave_struct_t * i2c, uint8_t event, bool stop, bool notify)
+{
+    BaseType_t woken = pdFALSE;
+    i2c_slave_rx_slot_t * slot = i2c_slave_rx_slot(i2c);
+    slot->event = event;
+    slot->stop = stop;
+    slot->stop_us = esp_timer_get_time();
+    __atomic_store_n(&i2c->rx_head, i2c->rx_head + 1, __ATOMIC_RELEASE);
+    if(notify){
+        vTaskNotifyGiveFromISR(i2c->task_handle, &woken);
+    }
+    return woken == pdTRUE;
+}
 #else
+static bool i2c_slave_rx_room(i2c_slave_struct_t * i2c, uint32_t len)
+{
+    return i2c->rx_pending + len <= i2c->rx_buf_len;
+}
+
+static bool i2c_slave_rx_store(i2c_slave_struct_t * i2c, uint32_t len, bool room)
+{
     uint8_t data[SOC_I2C_FIFO_LEN];
+    // a BaseType_t, not a bool: the ring writes a whole word through the pointer
+    BaseType_t pxHigherPriorityTaskWoken = pdFALSE;
+    if(!room){
+        i2c_slave_rx_discard(i2c, len);
+        return false;
+    }
+    i2c_ll_read_rxfifo(i2c->dev, data, len);
+    if(xRingbufferSendFromISR(i2c->rx_ring_buf, (void*) data, len, &pxHigherPriorityTaskWoken) != pdTRUE){
+        i2c->rx_stats.lost += len;
+    } else {
+        i2c->rx_pending += len;
+        i2c->rx_data_count += len;
+    }
+    return pxHigherPriorityTaskWoken == pdTRUE;
+}
 #endif
+
+// can_stall: the master is mid-write, so with no room the bytes can stay in
+// the FIFO and SCL is held once it fills. At a STOP there's nothing to hold,
+// bytes with no room are lost.
+static bool i2c_slave_handle_rx_fifo_full(i2c_slave_struct_t * i2c, uint32_t len, bool can_stall)
+{
     bool pxHigherPriorityTaskWoken = false;
-#if I2C_SLAVE_USE_RX_QUEUE
-    while (len > 0) {
-        i2c_ll_read_rxfifo(i2c->dev, (uint8_t*)&d, 1);
-        if(xQueueSendFromISR(i2c->rx_queue, &d, (BaseType_t * const)&pxHigherPriorityTaskWoken) != pdTRUE){
-            ESP_LOGE(TAG, "rx_queue_full");
-        } else {
-            i2c->rx_data_count++;
+    portENTER_CRITICAL_SAFE(&i2c->rx_lock);
+    // the task may have emptied the FIFO since the ISR looked, see i2c_slave_rx_resume
+    len = i2c_slave_rxfifo_cnt(i2c);
+    bool room = i2c_slave_rx_room(i2c, len);
+    if(len && can_stall && (i2c->rx_stalled || !room)){
+        // last resort: leave it to the hardware to stretch SCL
+        if(!i2c->rx_stalled){
+            i2c->rx_stalled = true;
+            i2c->rx_stats.stretches++;
+            i2c->dev->int_ena.val &= ~I2C_RXFIFO_WM_INT_ENA;
         }
-        if (--len == 0) {
-#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
-            i2c_ll_get_rxfifo_cnt(i2c->dev, &len);
+        len = 0;
+    } else if(i2c->rx_stalled){
+        // the write ended before the FIFO filled, nothing is being held
+        i2c->rx_stalled = false;
+        i2c->dev->int_ena.val |= I2C_RXFIFO_WM_INT_ENA;
+    }
+    if(len){
+        pxHigherPriorityTaskWoken = i2c_slave_rx_store(i2c, len, room);
+    }
+    portEXIT_CRITICAL_SAFE(&i2c->rx_lock);
+    return pxHigherPriorityTaskWoken;
+}
+
+// A write ended at a STOP or repeated START (I2C_SLAVE_EVT_RX), or a read began
+// (I2C_SLAVE_EVT_TX): pass it on to the task
+static bool i2c_slave_rx_finish(i2c_slave_struct_t * i2c, uint8_t event, bool stop)
+{
+    bool pxHigherPriorityTaskWoken = false;
+#if I2C_SLAVE_FAST_RX
+    portENTER_CRITICAL_SAFE(&i2c->rx_lock);
+    if(i2c_slave_rx_room(i2c, 0) && (event == I2C_SLAVE_EVT_TX || i2c_slave_rx_slot(i2c)->len)){
+        pxHigherPriorityTaskWoken = i2c_slave_rx_publish(i2c, event, stop, true);
+    }
+    portEXIT_CRITICAL_SAFE(&i2c->rx_lock);
 #else
-            len = i2c_ll_get_rxfifo_cnt(i2c->dev);
+    if(event == I2C_SLAVE_EVT_RX && !i2c->rx_data_count){
+        return false;
+    }
+    i2c_slave_queue_event_t e;
+    e.event = event;
+    e.stop = stop;
+    e.param = i2c->rx_data_count;
+    e.stop_us = esp_timer_get_time();
+    pxHigherPriorityTaskWoken = i2c_slave_send_event(i2c, &e);
+    i2c->rx_data_count = 0;
 #endif
+    return pxHigherPriorityTaskWoken;
+}
+
+// The master wants to read, SCL is held until the task has answered. The
+// bytes written before the repeated START go with the request.
+static bool i2c_slave_rx_read_request(i2c_slave_struct_t * i2c)
+{
+#if I2C_SLAVE_FAST_RX
+    bool pxHigherPriorityTaskWoken = false;
+    portENTER_CRITICAL_SAFE(&i2c->rx_lock);
+    if(i2c->rx_stalled){
+        // the read holds SCL now, not the FIFO
+        i2c->rx_stalled = false;
+        i2c->dev->int_ena.val |= I2C_RXFIFO_WM_INT_ENA;
+    }
+    uint32_t len = i2c_slave_rxfifo_cnt(i2c);
+    if(i2c_slave_rx_room(i2c, len)){
+        if(len){
+            i2c_slave_rx_store(i2c, len, true);
         }
+        pxHigherPriorityTaskWoken = i2c_slave_rx_publish(i2c, I2C_SLAVE_EVT_TX, false, true);
+    } else {
+        i2c->rx_read_pending = true;
+    }
+    portEXIT_CRITICAL_SAFE(&i2c->rx_lock);
+    return pxHigherPriorityTaskWoken;
 #else
-    if(len){
-        i2c_ll_read_rxfifo(i2c->dev, data, len);
-        if(xRingbufferSendFromISR(i2c->rx_ring_buf, (void*) data, len, (BaseType_t * const)&pxHigherPriorityTaskWoken) != pdTRUE){
-            ESP_LOGE(TAG, "rx_ring_buf_full");
-        } else {
-            i2c->rx_data_count += len;
-        }
+    //on C3 RX data dissapears with repeated start, so we need to get it here
+    bool pxHigherPriorityTaskWoken = i2c_slave_handle_rx_fifo_full(i2c, 0, false);
+    return pxHigherPriorityTaskWoken | i2c_slave_rx_finish(i2c, I2C_SLAVE_EVT_TX, false);
 #endif
+}
+
+// Task: there's room again, take what's held in the FIFO and let SCL go
+static void i2c_slave_rx_resume(i2c_slave_struct_t * i2c)
+{
+    portENTER_CRITICAL(&i2c->rx_lock);
+    uint32_t len = i2c_slave_rxfifo_cnt(i2c);
+    if(i2c->rx_stalled && i2c_slave_rx_room(i2c, len)){
+        if(len){
+            i2c_slave_rx_store(i2c, len, true);
+        }
+        i2c->rx_stalled = false;
+        i2c->dev->int_ena.val |= I2C_RXFIFO_WM_INT_ENA;
+        i2c_ll_stretch_clr(i2c->dev);
     }
-    return pxHigherPriorityTaskWoken;
+#if I2C_SLAVE_FAST_RX
+    if(i2c->rx_read_pending && i2c_slave_rx_room(i2c, len)){
+        if(len){
+            i2c_slave_rx_store(i2c, len, true);
+        }
+        // the task picks it up on its next pass, SCL stays held until then
+        i2c_slave_rx_publish(i2c, I2C_SLAVE_EVT_TX, false, false);
+        i2c->rx_read_pending = false;
+    }
+#endif
+    portEXIT_CRITICAL(&i2c->rx_lock);
 }
 
 static void i2c_slave_isr_handler(void* arg)
@@ -772,37 +1061,28 @@ static void i2c_slave_isr_handler(void* arg)
     bool slave_rw = i2c_ll_slave_rw(i2c->dev);
 
     if(activeInt & I2C_RXFIFO_WM_INT_ENA){ // RX FiFo Full
-        pxHigherPriorityTaskWoken |= i2c_slave_handle_rx_fifo_full(i2c, rx_fifo_len);
-        i2c_ll_slave_enable_rx_it(i2c->dev);//is this necessary?
+        pxHigherPriorityTaskWoken |= i2c_slave_handle_rx_fifo_full(i2c, rx_fifo_len, true);
+        if(!i2c->rx_stalled){
+            i2c_ll_slave_enable_rx_it(i2c->dev);//is this necessary?
+        }
     }
 
     if(activeInt & I2C_TRANS_COMPLETE_INT_ENA){ // STOP
         if(rx_fifo_len){ //READ RX FIFO
-            pxHigherPriorityTaskWoken |= i2c_slave_handle_rx_fifo_full(i2c, rx_fifo_len);
-        }
-        if(i2c->rx_data_count){ //WRITE or RepeatedStart
-            //SEND RX Event
-            i2c_slave_queue_event_t event;
-            event.event = I2C_SLAVE_EVT_RX;
-            event.stop = !slave_rw;
-            event.param = i2c->rx_data_count;
-            pxHigherPriorityTaskWoken |= i2c_slave_send_event(i2c, &event);
-            //Zero RX count
-            i2c->rx_data_count = 0;
+            pxHigherPriorityTaskWoken |= i2c_slave_handle_rx_fifo_full(i2c, rx_fifo_len, false);
         }
+        //WRITE or RepeatedStart: SEND RX Event
+        pxHigherPriorityTaskWoken |= i2c_slave_rx_finish(i2c, I2C_SLAVE_EVT_RX, !slave_rw);
         if(slave_rw){ // READ
 #if CONFIG_IDF_TARGET_ESP32
             if(i2c->dev->status_reg.scl_main_state_last == 6){
                 //SEND TX Event
-                i2c_slave_queue_event_t event;
-                event.event = I2C_SLAVE_EVT_TX;
-                pxHigherPriorityTaskWoken |= i2c_slave_send_event(i2c, &event);
+                pxHigherPriorityTaskWoken |= i2c_slave_rx_finish(i2c, I2C_SLAVE_EVT_TX, false);
             }
 #else
             //reset TX data
             i2c_ll_txfifo_rst(i2c->dev);
-            uint8_t d;
-            while (xQueueReceiveFromISR(i2c->tx_queue, &d, (BaseType_t * const)&pxHigherPriorityTaskWoken) == pdTRUE) ;//flush partial write
+            i2c_slave_tx_reset(i2c);//flush partial write
 #endif
         }
     }
@@ -814,20 +1094,8 @@ static void i2c_slave_isr_handler(void* arg)
 #endif
         i2c_stretch_cause_t cause = i2c_ll_stretch_cause(i2c->dev);
         if(cause == I2C_STRETCH_CAUSE_MASTER_READ){
-            //on C3 RX data dissapears with repeated start, so we need to get it here
-            if(rx_fifo_len){
-                pxHigherPriorityTaskWoken |= i2c_slave_handle_rx_fifo_full(i2c, rx_fifo_len);
-            }
             //SEND TX Event
-            i2c_slave_queue_event_t event;
-            if (i2c->rx_data_count) {
-                event.param = i2c->rx_data_count;
-            } else {
-                event.param = 0;
-            }
-            event.event = I2C_SLAVE_EVT_TX;
-            pxHigherPriorityTaskWoken |= i2c_slave_send_event(i2c, &event);
-            i2c->rx_data_count = 0;
+            pxHigherPriorityTaskWoken |= i2c_slave_rx_read_request(i2c);
             //will clear after execution
         } else if(cause == I2C_STRETCH_CAUSE_TX_FIFO_EMPTY){
             pxHigherPriorityTaskWoken |= i2c_slave_handle_tx_fifo_empty(i2c);
@@ -836,8 +1104,10 @@ static void i2c_slave_isr_handler(void* arg)
             gpio_set_level(DEBUG_IO3, 0);
 #endif
         } else if(cause == I2C_STRETCH_CAUSE_RX_FIFO_FULL){
-            pxHigherPriorityTaskWoken |= i2c_slave_handle_rx_fifo_full(i2c, rx_fifo_len);
-            i2c_ll_stretch_clr(i2c->dev);
+            pxHigherPriorityTaskWoken |= i2c_slave_handle_rx_fifo_full(i2c, rx_fifo_len, true);
+            if(!i2c->rx_stalled){
+                i2c_ll_stretch_clr(i2c->dev);
+            }
 #ifdef DEBUG_MODE
             gpio_set_level(DEBUG_IO3, 0);
 #endif
@@ -854,36 +1124,81 @@ static void i2c_slave_isr_handler(void* arg)
     }
 }
 
-static size_t i2c_slave_read_rx(i2c_slave_struct_t * i2c, uint8_t * data, size_t len){
-    if(!len){
-        return 0;
+// Task: one write or read request to the callbacks
+static void i2c_slave_dispatch(i2c_slave_struct_t * i2c, uint8_t event, uint8_t * data, size_t len, bool stop, int64_t stop_us)
+{
+    uint32_t dispatch_us = (uint32_t)(esp_timer_get_time() - stop_us);
+    i2c->rx_stats.dispatches++;
+    i2c->rx_stats.dispatch_us_last = dispatch_us;
+    i2c->rx_stats.dispatch_us_total += dispatch_us;
+    if(dispatch_us > i2c->rx_stats.dispatch_us_max){
+        i2c->rx_stats.dispatch_us_max = dispatch_us;
     }
-#if I2C_SLAVE_USE_RX_QUEUE
-    uint8_t d = 0;
-    BaseType_t res = pdTRUE;
-    for(size_t i=0; i<len; i++) {
-        if(data){
-            res = xQueueReceive(i2c->rx_queue, &data[i], 0);
-        } else {
-            res = xQueueReceive(i2c->rx_queue, &d, 0);
+    // Write
+    if(event == I2C_SLAVE_EVT_RX){
+        if(i2c->receive_callback){
+        #ifdef DEBUG_MODE
+            gpio_set_level(DEBUG_IO, 1);
+        #endif
+            i2c->receive_callback(i2c->num, data, len, stop, i2c->arg);
+        #ifdef DEBUG_MODE
+            gpio_set_level(DEBUG_IO, 0);
+        #endif
         }
-        if (res != pdTRUE) {
-            ESP_LOGE(TAG, "Read Queue(%u) Failed", i);
-            len = i;
-            break;
+    // Read
+    } else if(event == I2C_SLAVE_EVT_TX){
+        if(i2c->request_callback) {
+        #ifdef DEBUG_MODE
+            gpio_set_level(DEBUG_IO2, 1);
+        #endif
+            // clear the history data in tx fifo
+            i2c_ll_txfifo_rst(i2c->dev);
+            i2c_slave_tx_reset(i2c);
+            // the callback only takes a byte of length, a longer prefix is cut
+            i2c->request_callback(i2c->num, data, len > 255 ? 255 : len, i2c->arg);
+        #ifdef DEBUG_MODE
+            gpio_set_level(DEBUG_IO2, 0);
+        #endif
+        }
+        i2c_ll_stretch_clr(i2c->dev);
+#ifdef DEBUG_MODE
+        gpio_set_level(DEBUG_IO3, 0);
+#endif
+    }
+}
+
+#if I2C_SLAVE_FAST_RX
+static void i2c_slave_task(void *pv_args)
+{
+    i2c_slave_struct_t * i2c = (i2c_slave_struct_t *)pv_args;
+    uint32_t tail = 0;
+    for(;;){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // the callbacks get the slot itself, then it goes back to the ISR
+        while(tail != __atomic_load_n(&i2c->rx_head, __ATOMIC_ACQUIRE)){
+            i2c_slave_rx_slot_t * slot = &i2c->rx_slots[tail & (I2C_SLAVE_RX_SLOTS - 1)];
+            i2c_slave_dispatch(i2c, slot->event, slot->data, slot->len, slot->stop, slot->stop_us);
+            slot->len = 0;
+            __atomic_store_n(&i2c->rx_tail, ++tail, __ATOMIC_RELEASE);
+            i2c_slave_rx_resume(i2c);
         }
     }
-    return (data)?len:0;
+    vTaskDelete(NULL);
+}
 #else
-    size_t  dlen = 0, 
-            to_read = len, 
-            so_far = 0, 
-            available = 0;
+static size_t i2c_slave_read_rx(i2c_slave_struct_t * i2c, uint8_t * data, size_t len){
+    if(!len){
+        return 0;
+    }
+    size_t  dlen = 0,
+            to_read = len,
+            so_far = 0;
+    UBaseType_t available = 0;
     uint8_t * rx_data = NULL;
 
     vRingbufferGetInfo(i2c->rx_ring_buf, NULL, NULL, NULL, NULL, &available);
     if(available < to_read){
-        ESP_LOGE(TAG, "Less available than requested. %u < %u", available, len);
+        ESP_LOGE(TAG, "Less available than requested. %u < %u", (unsigned)available, (unsigned)len);
         to_read = available;
     }
 
@@ -891,76 +1206,39 @@ static size_t i2c_slave_read_rx(i2c_slave_struct_t * i2c, uint8_t * data, size_t
         dlen = 0;
         rx_data = (uint8_t *)xRingbufferReceiveUpTo(i2c->rx_ring_buf, &dlen, 0, to_read);
         if(!rx_data){
-            ESP_LOGE(TAG, "Receive %u Failed", to_read);
+            ESP_LOGE(TAG, "Receive %u Failed", (unsigned)to_read);
             return so_far;
         }
         if(data){
             memcpy(data+so_far, rx_data, dlen);
         }
         vRingbufferReturnItem(i2c->rx_ring_buf, rx_data);
+        portENTER_CRITICAL(&i2c->rx_lock);
+        i2c->rx_pending -= dlen;
+        portEXIT_CRITICAL(&i2c->rx_lock);
         so_far+=dlen;
         to_read-=dlen;
     }
+    i2c_slave_rx_resume(i2c);
     return (data)?so_far:0;
-#endif
 }
 
-uint8_t data_rx_buf[512];
-
 static void i2c_slave_task(void *pv_args)
 {
     i2c_slave_struct_t * i2c = (i2c_slave_struct_t *)pv_args;
     i2c_slave_queue_event_t event;
     size_t len = 0;
-    bool stop = false;
-    //uint8_t * data = NULL;
     for(;;){
         if(xQueueReceive(i2c->event_queue, &event, portMAX_DELAY) == pdTRUE){
-            // Write
-            if(event.event == I2C_SLAVE_EVT_RX){
-                len = event.param;
-                stop = event.stop;
-                //data = (len > 0)?(uint8_t*)malloc(len):NULL;
-
-                //if(len && data == NULL){
-                //    ESP_LOGE(TAG, "Malloc (%u) Failed", len);
-                //}
-                len = i2c_slave_read_rx(i2c, data_rx_buf, len);
-                if(i2c->receive_callback){
-                #ifdef DEBUG_MODE
-                    gpio_set_level(DEBUG_IO, 1);
-                #endif
-                    i2c->receive_callback(i2c->num, data_rx_buf, len, stop, i2c->arg);
-                #ifdef DEBUG_MODE
-                    gpio_set_level(DEBUG_IO, 0);
-                #endif
-                }
-                //free(data);
-
-            // Read
-            } else if(event.event == I2C_SLAVE_EVT_TX){
-                if(i2c->request_callback) {
-                    len = event.param;
-                    //data = (len > 0)?(uint8_t*)malloc(len):NULL;
-                    len = i2c_slave_read_rx(i2c, data_rx_buf, len);
-                #ifdef DEBUG_MODE
-                    gpio_set_level(DEBUG_IO2, 1);
-                #endif
-                    // clear the history data in tx fifo
-                    i2c_ll_txfifo_rst(i2c->dev);
-                    xQueueReset(i2c->tx_queue);
-                    i2c->request_callback(i2c->num, data_rx_buf, len, i2c->arg);
-                #ifdef DEBUG_MODE
-                    gpio_set_level(DEBUG_IO2, 0);
-                #endif
-                    //free(data);
-                }
-                i2c_ll_stretch_clr(i2c->dev);
-#ifdef DEBUG_MODE
-            gpio_set_level(DEBUG_IO3, 0);
-#endif
+            len = event.param;
+            // the ring never holds more than rx_buf_len, this is belt and braces
+            if(len > i2c->rx_buf_len){
+                len = i2c->rx_buf_len;
             }
+            len = i2c_slave_read_rx(i2c, i2c->rx_buf, len);
+            i2c_slave_dispatch(i2c, event.event, i2c->rx_buf, len, event.stop, event.stop_us);
         }
     }
     vTaskDelete(NULL);
 }
+#endif
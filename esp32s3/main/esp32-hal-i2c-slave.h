@@ -31,6 +31,15 @@ esp_err_t i2cSlaveAttachCallbacks(uint8_t num, i2c_slave_request_cb_t request_ca
 esp_err_t i2cSlaveInit(uint8_t num, int sda, int scl, uint16_t slaveID, uint32_t frequency, size_t rx_len, size_t tx_len);
 esp_err_t i2cSlaveDeinit(uint8_t num);
 size_t i2cSlaveWrite(uint8_t num, const uint8_t *buf, uint32_t len, uint32_t timeout_ms);
+typedef struct {
+    uint32_t stretches;         // times SCL was held for want of RX room
+    uint32_t lost;              // bytes lost for want of RX room
+    uint32_t dispatches;        // writes and read requests handed to the callbacks
+    uint32_t dispatch_us_last;  // STOP (or read request) in the ISR to the callback
+    uint32_t dispatch_us_max;
+    uint64_t dispatch_us_total;
+} i2c_slave_rx_stats_t;
+esp_err_t i2cSlaveGetRxStats(uint8_t num, i2c_slave_rx_stats_t *stats);
 
 #ifdef __cplusplus
 }
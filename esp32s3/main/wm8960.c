@@ -37,6 +37,7 @@
 ******************************************************************************/
 
 #include "wm8960.h"
+#include "freertos/semphr.h"
 
 // The WM8960 does not support I2C reads
 // This means we must keep a local copy of all the register values
@@ -48,7 +49,7 @@
 // "reserved" registers. This way we can use the register address macro 
 // defines above to easiy access each local copy of each register.
 // Example: _registerLocalCopy[WM8960_REG_LEFT_INPUT_VOLUME]
-uint16_t _registerLocalCopy[56] = {
+static uint16_t _registerLocalCopy[56] = {
     0x0097, // R0 (0x00)
     0x0097, // R1 (0x01)
     0x0000, // R2 (0x02)
@@ -167,76 +168,48 @@ const uint16_t _registerDefaults[56] = {
 };   
 
 
-// This sets up with OUT3/HP at line level volume
-// and with INPUT1 ADC coming in to i2s
-esp_err_t setup_wm8960_i2s() {
+// Settings change from more than one task (the transports, the codec worker),
+// so each read-modify-write of the local copy, and the write it hands to
+// writeRegister, happens under this lock. Otherwise two changes to one register
+// could each start from the old value, or reach the queue in the other order.
+static SemaphoreHandle_t local_copy_lock = NULL;
+#define LOCAL_COPY_LOCK()   xSemaphoreTake(local_copy_lock, portMAX_DELAY)
+#define LOCAL_COPY_UNLOCK() xSemaphoreGive(local_copy_lock)
 
-    enableVREF();
-    enableVMID();
+esp_err_t wm8960_init() {
+  if(!local_copy_lock) local_copy_lock = xSemaphoreCreateMutex();
+  return local_copy_lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
 
-    enableLMIC();
-    enableRMIC();
+static uint32_t writes = 0;
 
-    connectLMN1();
-    connectRMN1();
+uint32_t wm8960_get_writes() {
+    return writes;
+}
 
-    disableLINMUTE();
-    disableRINMUTE();
-    
-    setLINVOLDB(0);
-    setRINVOLDB(0);
-    
-    setLMICBOOST(WM8960_MIC_BOOST_GAIN_0DB);
-    setRMICBOOST(WM8960_MIC_BOOST_GAIN_0DB);
+extern esp_err_t i2c_master_write_wm8960(uint8_t *data_wr, size_t size_wr);
+extern esp_err_t i2c_master_write_wm8960_batch(uint8_t *writes, size_t count);
 
-    connectLMIC2B();
-    connectRMIC2B();
+// Register writes held back by wm8960_batch_begin, 2 bytes each as they go on the wire
+#define WM8960_BATCH_MAX 64
+static uint8_t batch[WM8960_BATCH_MAX * 2];
+static size_t batch_count = 0;
+static bool batching = false;
 
-    enableAINL();
-    enableAINR();
-    
-    disableLB2LO();
-    disableRB2RO();
-
-    enableLD2LO();
-    enableRD2RO();
-    setLB2LOVOL(WM8960_OUTPUT_MIXER_GAIN_NEG_21DB); 
-    setRB2ROVOL(WM8960_OUTPUT_MIXER_GAIN_NEG_21DB); 
-
-    enableLOMIX();
-    enableROMIX();
-
-    enablePLL();
-    setPLLPRESCALE(WM8960_PLLPRESCALE_DIV_2);
-    setSMD(WM8960_PLL_MODE_FRACTIONAL);
-    setCLKSEL(WM8960_CLKSEL_PLL);
-    setSYSCLKDIV(WM8960_SYSCLK_DIV_BY_2);
-    setBCLKDIV(4);
-    setDCLKDIV(WM8960_DCLKDIV_16);
-    setPLLN(7);
-    setPLLK(0x86, 0xC2, 0x26);
-    setWL(WM8960_WL_16BIT);
-    enablePeripheralMode();
-
-    enableAdcLeft();
-    enableAdcRight();
-
-    enableDacLeft();
-    enableDacRight();
-    disableDacMute();
-
-    disableLoopBack();
-
-    disableDacMute();
-
-    enableHeadphones();
-    enableOUT3MIX();
-    setHeadphoneVolumeDB(0.00); // line level 
-    return ESP_OK;
+static esp_err_t batch_flush() {
+  esp_err_t ret = i2c_master_write_wm8960_batch(batch, batch_count);
+  batch_count = 0;
+  return ret;
 }
 
+void wm8960_batch_begin() {
+  batching = true;
+}
 
-extern esp_err_t i2c_master_write_wm8960(uint8_t *data_wr, size_t size_wr);
+esp_err_t wm8960_batch_end() {
+  batching = false;
+  return batch_flush();
+}
 
 // writeRegister(uint8_t reg, uint16_t value)
 // General-purpose write to a register
@@ -248,7 +221,7 @@ extern esp_err_t i2c_master_write_wm8960(uint8_t *data_wr, size_t size_wr);
 // Control_byte_1 = register-to-write address (7-bits) plus 9th bit of data
 // Control_byte_2 = remaining 8 bits of register data
 
-void writeRegister(uint8_t reg, uint16_t value) {
+esp_err_t wm8960_write_register_now(uint8_t reg, uint16_t value) {
   uint8_t data[2];
 
   // Shift reg over one spot to make room for the 9th bit of register data
@@ -259,13 +232,47 @@ void writeRegister(uint8_t reg, uint16_t value) {
   data[0] |= (value >> 8); 
 
   data[1] = (uint8_t)(value & 0xFF);
-  i2c_master_write_wm8960(data,2);  
+  writes++;
+  if(batching) {
+    batch[batch_count * 2] = data[0];
+    batch[batch_count * 2 + 1] = data[1];
+    if(++batch_count == WM8960_BATCH_MAX) return batch_flush();
+    return ESP_OK;
+  }
+  return i2c_master_write_wm8960(data,2);  
+}
+
+// Queues writes instead of sending them, see wm8960_set_async
+static bool (*queue_write)(uint8_t reg, uint16_t value) = NULL;
+
+void wm8960_set_async(bool (*queue)(uint8_t reg, uint16_t value)) {
+  queue_write = queue;
+}
+
+void writeRegister(uint8_t reg, uint16_t value) {
+  if(queue_write) {
+    queue_write(reg, value);
+    return;
+  }
+  wm8960_write_register_now(reg, value);
+}
+
+// Whole register values from a table, in order, keeping the local copy in step
+void wm8960_write_table(const wm8960_reg_t *table, size_t count)
+{
+  for(size_t i = 0; i < count; i++) {
+    LOCAL_COPY_LOCK();
+    writeRegister(table[i].reg, table[i].value);
+    _registerLocalCopy[table[i].reg] = table[i].value;
+    LOCAL_COPY_UNLOCK();
+  }
 }
 
 // writeRegisterBit
 // Writes a 0 or 1 to the desired bit in the desired register
 void _writeRegisterBit(uint8_t registerAddress, uint8_t bitNumber, uint8_t bitValue)
 {
+    LOCAL_COPY_LOCK();
     // Get the local copy of the register
     uint16_t regvalue = _registerLocalCopy[registerAddress]; 
 
@@ -281,6 +288,7 @@ void _writeRegisterBit(uint8_t registerAddress, uint8_t bitNumber, uint8_t bitVa
     // If successful, update local copy
     writeRegister(registerAddress, regvalue);
     _registerLocalCopy[registerAddress] = regvalue; 
+    LOCAL_COPY_UNLOCK();
 }
 
 // writeRegisterMultiBits
@@ -296,6 +304,7 @@ void _writeRegisterMultiBits(uint8_t registerAddress, uint8_t settingMsbNum, uin
 {
   uint8_t numOfBits = (settingMsbNum - settingLsbNum) + 1;
 
+  LOCAL_COPY_LOCK();
   // Get the local copy of the register
   uint16_t regvalue = _registerLocalCopy[registerAddress]; 
 
@@ -311,6 +320,7 @@ void _writeRegisterMultiBits(uint8_t registerAddress, uint8_t settingMsbNum, uin
   // If successful, update local copy
   writeRegister(registerAddress, regvalue);
   _registerLocalCopy[registerAddress] = regvalue; 
+  LOCAL_COPY_UNLOCK();
 }
 
 // enableVREF
@@ -339,13 +349,15 @@ void disableVREF()
 // Returns 1 if successful, 0 if something failed (I2C error)
 void reset()
 {
+  LOCAL_COPY_LOCK();
   // Doesn't matter which bit we flip, writing anything will cause the reset
-  _writeRegisterBit(WM8960_REG_RESET, 7, 1);
+  writeRegister(WM8960_REG_RESET, _registerLocalCopy[WM8960_REG_RESET] | (1 << 7));
   // Update our local copy of the registers to reflect the reset
   for(int i = 0 ; i < 56 ; i++)
   {
     _registerLocalCopy[i] = _registerDefaults[i]; 
   }
+  LOCAL_COPY_UNLOCK();
 }
 
 void enableAINL()
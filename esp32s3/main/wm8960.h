@@ -328,7 +328,33 @@
 #define WM8960_VSEL_INCREASED_BIAS_CURRENT 1
 #define WM8960_VSEL_LOWEST_BIAS_CURRENT 3
 
-esp_err_t setup_wm8960_i2s();
+// Before anything else: creates the lock that keeps the local register copy
+// consistent when settings change from more than one task
+esp_err_t wm8960_init();
+
+// Register writes sent since boot
+uint32_t wm8960_get_writes();
+
+// A whole register value, for the compile time tables in amychip_codec_wm8960.c
+typedef struct {
+    uint8_t reg;
+    uint16_t value;
+} wm8960_reg_t;
+void wm8960_write_table(const wm8960_reg_t *table, size_t count);
+
+// Register writes between these go out back to back when the batch ends (or
+// fills), instead of one at a time as each setting changes
+void wm8960_batch_begin();
+esp_err_t wm8960_batch_end();
+
+// Hand every register write from here on to queue (amychip_codec_write) rather
+// than waiting on the I2C master, NULL to write straight away again. The queue's
+// worker sends them with wm8960_write_register_now. The local register copy is
+// still updated straight away, under the same lock as the queueing, so later
+// bit changes build on queued values and reach the queue in the same order.
+void wm8960_set_async(bool (*queue)(uint8_t reg, uint16_t value));
+esp_err_t wm8960_write_register_now(uint8_t reg, uint16_t value);
+
 void enableVREF(); // Necessary for all other functions
 void disableVREF(); // Use for turning this off to save power
 